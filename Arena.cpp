@@ -0,0 +1,99 @@
+#include "Arena.h"
+#include <cstring>
+
+// Blocks are this big unless a single request needs more.
+static const size_t ARENA_BLOCK_BYTES = 1 << 20;
+
+Arena::Arena() : blocks(nullptr), numBlocks(0), maxBlocks(0), current(0), used(0), numFreeLists(0) {
+}
+
+Arena::~Arena() {
+    for (int i = 0; i < numBlocks; i++)
+        delete[] blocks[i].data;
+    delete[] blocks;
+    blocks = nullptr;
+}
+
+// Move on to the next block that can hold 'bytes', reusing blocks kept by reset().
+void Arena::nextBlock(size_t bytes) {
+    while (current + 1 < numBlocks) {
+        current++;
+        used = 0;
+        if (blocks[current].size >= bytes)
+            return;
+    }
+    if (numBlocks >= maxBlocks) {
+        int newMax = (maxBlocks == 0) ? 16 : maxBlocks * 2;
+        Block *newBlocks = new Block[newMax];
+        for (int i = 0; i < numBlocks; i++)
+            newBlocks[i] = blocks[i];
+        delete[] blocks;
+        blocks = newBlocks;
+        maxBlocks = newMax;
+    }
+    size_t size = (bytes > ARENA_BLOCK_BYTES) ? bytes : ARENA_BLOCK_BYTES;
+    blocks[numBlocks].data = new char[size];
+    blocks[numBlocks].size = size;
+    current = numBlocks++;
+    used = 0;
+}
+
+void *Arena::allocate(size_t bytes, size_t align) {
+    for (int i = 0; i < numFreeLists; i++) {
+        if (freeLists[i].bytes == bytes && freeLists[i].head != nullptr) {
+            void *p = freeLists[i].head;
+            memcpy(&freeLists[i].head, p, sizeof(void *));
+            return p;
+        }
+    }
+    // new[] blocks are aligned for any fundamental type, so aligning the offset is enough.
+    size_t offset = (used + align - 1) & ~(align - 1);
+    if (numBlocks == 0 || offset + bytes > blocks[current].size) {
+        nextBlock(bytes);
+        offset = 0;
+    }
+    used = offset + bytes;
+    return blocks[current].data + offset;
+}
+
+// Give a block back for reuse by the next allocate() of the same size. Sizes beyond
+// the first FREE_LISTS distinct ones (or too small to hold a pointer) are only
+// reclaimed by reset().
+void Arena::release(void *p, size_t bytes) {
+    if (p == nullptr || bytes < sizeof(void *))
+        return;
+    int i = 0;
+    while (i < numFreeLists && freeLists[i].bytes != bytes)
+        i++;
+    if (i == numFreeLists) {
+        if (numFreeLists == FREE_LISTS)
+            return;
+        freeLists[numFreeLists].bytes = bytes;
+        freeLists[numFreeLists].head = nullptr;
+        numFreeLists++;
+    }
+    memcpy(p, &freeLists[i].head, sizeof(void *));
+    freeLists[i].head = p;
+}
+
+std::string_view Arena::copy(std::string_view s) {
+    if (s.empty())
+        return std::string_view();
+    char *p = static_cast<char *>(allocate(s.size(), 1));
+    memcpy(p, s.data(), s.size());
+    return std::string_view(p, s.size());
+}
+
+// Drop everything allocated so far. The blocks stay allocated for reuse.
+void Arena::reset() {
+    current = 0;
+    used = 0;
+    numFreeLists = 0;
+}
+
+size_t Arena::bytesReserved() const {
+    size_t total = 0;
+    for (int i = 0; i < numBlocks; i++)
+        total += blocks[i].size;
+    return total;
+}
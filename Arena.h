@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <string_view>
+
+// Arena: a bump allocator for objects that are all dropped together (the countries of a
+// LOAD, their series arrays and names). reset() releases everything in O(blocks) and
+// keeps the blocks for the next fill, so a reload does no malloc/free per object.
+// Objects placed here are never destroyed, so they must be trivially destructible.
+//
+// Blocks given back with release() are kept on per-size free lists and handed out again
+// by allocate() for the same size; that keeps INSERT/REMOVE churn from growing the arena.
+class Arena {
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+    struct FreeList {
+        size_t bytes;
+        void *head;   // each free block stores the next one in its first word
+    };
+    static const int FREE_LISTS = 16;
+
+    Block *blocks;
+    int numBlocks;
+    int maxBlocks;
+    int current;       // block being filled
+    size_t used;       // bytes used in the current block
+    FreeList freeLists[FREE_LISTS];
+    int numFreeLists;
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void nextBlock(size_t bytes);
+
+public:
+    Arena();
+    ~Arena();
+
+    void *allocate(size_t bytes, size_t align);
+    void release(void *p, size_t bytes);
+    std::string_view copy(std::string_view s);
+    void reset();
+    size_t bytesReserved() const;
+
+    template <class T>
+    T *allocateArray(size_t n) {
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+    }
+};
+
+#endif
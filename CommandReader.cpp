@@ -0,0 +1,155 @@
+#include "CommandReader.h"
+#include <charconv>
+#include <cerrno>
+#include <unistd.h>
+
+// Input is read in blocks of this many bytes; output is flushed once per block.
+static const size_t COMMAND_BLOCK_BYTES = 1 << 16;
+
+// Whitespace as the "C" locale's isspace sees it.
+static inline bool isSpace(int c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+CommandReader::CommandReader(int inputFd, std::ostream *flushBeforeRead)
+    : fd(inputFd), buffer(new char[COMMAND_BLOCK_BYTES]), pos(0), length(0), atEnd(false), failed(false),
+      flushOut(flushBeforeRead)
+{
+}
+
+CommandReader::~CommandReader() {
+    delete[] buffer;
+    buffer = nullptr;
+}
+
+// Replace the (fully consumed) buffer with the next block. Returns false at end of input.
+bool CommandReader::fill() {
+    if (atEnd)
+        return false;
+    if (flushOut != nullptr)
+        flushOut->flush();
+    pos = 0;
+    length = 0;
+    ssize_t n;
+    do {
+        n = ::read(fd, buffer, COMMAND_BLOCK_BYTES);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        atEnd = true;
+        return false;
+    }
+    length = (size_t)n;
+    return true;
+}
+
+// Skip whitespace; false (and failed from then on) if the input ends first.
+bool CommandReader::skipSpace() {
+    if (failed)
+        return false;
+    int c;
+    while ((c = peek()) != -1 && isSpace(c))
+        pos++;
+    if (c == -1)
+        failed = true;
+    return !failed;
+}
+
+bool CommandReader::word(std::string &w) {
+    w.clear();
+    if (!skipSpace())
+        return false;
+    do {
+        size_t start = pos;
+        while (pos < length && !isSpace(buffer[pos]))
+            pos++;
+        w.append(buffer + start, pos - start);
+    } while (pos == length && fill());
+    return true;
+}
+
+bool CommandReader::line(std::string &l) {
+    if (!skipSpace())
+        return false;
+    l.clear();
+    while (true) {
+        size_t start = pos;
+        while (pos < length && buffer[pos] != '\n')
+            pos++;
+        l.append(buffer + start, pos - start);
+        if (pos < length) {
+            pos++; // the newline is consumed, not stored
+            break;
+        }
+        if (!fill())
+            break;
+    }
+    return true;
+}
+
+// The rest of the current line, which may be empty.
+bool CommandReader::rest(std::string &l) {
+    l.clear();
+    if (failed || peek() == -1)
+        return false;
+    while (true) {
+        size_t start = pos;
+        while (pos < length && buffer[pos] != '\n')
+            pos++;
+        l.append(buffer + start, pos - start);
+        if (pos < length) {
+            pos++;
+            break;
+        }
+        if (!fill())
+            break;
+    }
+    return true;
+}
+
+// Take the longest prefix that fits a decimal float (sign, digits, one point, one
+// exponent after some digits), then require all of it to convert, as num_get does:
+// "12abc" reads 12 and leaves "abc", while "1e" or "." fails.
+bool CommandReader::number(double &d) {
+    d = 0.0;
+    if (!skipSpace())
+        return false;
+    std::string text;
+    int c = peek();
+    if (c == '+' || c == '-') {
+        text += (char)c;
+        pos++;
+    }
+    bool digits = false;
+    bool point = false;
+    bool exponent = false;
+    while ((c = peek()) != -1) {
+        if (c >= '0' && c <= '9') {
+            digits = true;
+        } else if (c == '.' && !point && !exponent) {
+            point = true;
+        } else if ((c == 'e' || c == 'E') && !exponent && digits) {
+            exponent = true;
+            text += (char)c;
+            pos++;
+            c = peek();
+            if (c != '+' && c != '-')
+                continue;
+        } else {
+            break;
+        }
+        text += (char)c;
+        pos++;
+    }
+    const char *first = text.data();
+    const char *last = first + text.size();
+    if (first < last && *first == '+')
+        first++;
+    double value = 0.0;
+    std::from_chars_result r = std::from_chars(first, last, value);
+    if (first == last || r.ec != std::errc() || r.ptr != last) {
+        failed = true;
+        return false;
+    }
+    d = value;
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef COMMAND_READER_H
+#define COMMAND_READER_H
+
+#include <string>
+#include <ostream>
+#include <cstddef>
+
+// CommandReader: a buffered tokenizer for the batch command loop. It reads a file
+// descriptor in large blocks and splits it the way the interactive loop's
+// std::cin extractions do, so both modes see exactly the same arguments.
+// Once an extraction fails (end of input, or a malformed number), every later one
+// fails too, like a stream with failbit set.
+class CommandReader {
+private:
+    int fd;
+    char *buffer;
+    size_t pos;
+    size_t length;
+    bool atEnd;
+    bool failed;
+    std::ostream *flushOut;
+
+    CommandReader(const CommandReader &) = delete;
+    CommandReader &operator=(const CommandReader &) = delete;
+
+    bool fill();
+    int peek() { return (pos < length || fill()) ? (unsigned char)buffer[pos] : -1; }
+    bool skipSpace();
+
+public:
+    // 'flushOut', if given, is flushed before each read that may block, so output for
+    // one input block is written before waiting on the next.
+    CommandReader(int inputFd, std::ostream *flushBeforeRead);
+    ~CommandReader();
+
+    bool word(std::string &w);     // std::cin >> w
+    bool line(std::string &l);     // std::getline(std::cin >> std::ws, l)
+    bool rest(std::string &l);     // std::getline(std::cin, l)
+    bool number(double &d);        // std::cin >> d
+};
+
+#endif
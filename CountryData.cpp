@@ -1,532 +1,2391 @@
 #include "CountryData.h"
+#include "CsvReader.h"
+#include "RowIndex.h"
+#include "SeriesKernels.h"
+#include "Snapshot.h"
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <thread>
 
-// SERIES IMPLEMENTATION
-CountryData::Series::Series(const std::string &name, const std::string &code)
-    : seriesName(name), seriesCode(code), years(nullptr), values(nullptr),
-      numEntries(0), maxEntries(10), next(nullptr)
+#ifdef COUNTRYDATA_SWISS_TABLE
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Swiss table control bytes: the high bit marks a free slot (empty or deleted), otherwise
+// the low seven bits are the fingerprint of the code in the slot. Slots are probed in
+// groups of GROUP_SLOTS, one control-byte compare per group.
+static const uint8_t CTRL_EMPTY = 0x80;
+static const uint8_t CTRL_DELETED = 0xFE;
+static const int GROUP_SLOTS = 16;
+
+static inline uint64_t swissHash(unsigned int W) {
+    return (uint64_t)W * 0x9E3779B97F4A7C15ULL;
+}
+
+// The top seven bits of the hash are the fingerprint; bits 32 and up pick the first group.
+static inline uint8_t fingerprint(uint64_t hash) {
+    return (uint8_t)(hash >> 57);
+}
+
+// Bit i set = control byte i of the group equals 'value'.
+static inline unsigned matchByte(const uint8_t *group, uint8_t value) {
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)value)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < GROUP_SLOTS; i++)
+        if (group[i] == value)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+
+// Bit i set = slot i of the group is free.
+static inline unsigned matchFree(const uint8_t *group) {
+#ifdef __SSE2__
+    return (unsigned)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(group)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < GROUP_SLOTS; i++)
+        if (group[i] & 0x80)
+            mask |= 1u << i;
+    return mask;
+#endif
+}
+#endif
+
+// COLUMN IMPLEMENTATION
+CountryData::Column::Column(const std::string &code, int columnId)
+    : seriesCode(code), id(columnId), values(nullptr), validity(nullptr), size(0), capacity(0), deadValues(0),
+      mapped(false), refs(nullptr), numRefs(0), maxRefs(0), windowsCurrent(false), dirtyFrom(0), codeId(StringPool::NO_STRING),
+      textRows(nullptr), numTextRows(0), maxTextRows(0)
 {
-    // Allocate initial arrays
-    years = new int[maxEntries];
-    values = new double[maxEntries];
-    for (int i = 0; i < maxEntries; i++) {
-        years[i] = 0;
-        values[i] = 0.0;
+}
+
+CountryData::Column::~Column() {
+    if (!mapped) {
+        delete[] values;
+        delete[] validity;
+    }
+    delete[] refs;
+    delete[] textRows;
+    values = nullptr;
+    validity = nullptr;
+    refs = nullptr;
+    textRows = nullptr;
+}
+
+// Make room for at least 'extra' more values, doubling like the old Series::resize.
+// Capacity stays a multiple of 64 so the validity bitmap is a whole number of words.
+// A column still in a snapshot mapping is copied out here, the first time it is written,
+// and a packed column is decoded back into a buffer. The packed copy is kept, so packing
+// again after the write only has to code the blocks from dirtyFrom on.
+void CountryData::Column::reserve(int extra) {
+    if (size + extra <= capacity && !mapped && values != nullptr)
+        return;
+    int newCapacity = (capacity == 0) ? 64 : capacity;
+    while (newCapacity < size + extra)
+        newCapacity *= 2;
+    double *newValues = new double[newCapacity];
+    uint64_t *newValidity = new uint64_t[newCapacity / 64];
+    if (size > 0 && values == nullptr) {
+        packed.decode(validity, size, newValues);
+        dirtyFrom = size;
+    } else if (size > 0) {
+        memcpy(newValues, values, size * sizeof(double));
     }
+    int oldWords = capacity / 64;
+    for (int i = 0; i < newCapacity / 64; i++)
+        newValidity[i] = (i < oldWords) ? validity[i] : 0;
+    if (!mapped) {
+        delete[] values;
+        delete[] validity;
+    }
+    values = newValues;
+    validity = newValidity;
+    capacity = newCapacity;
+    mapped = false;
 }
 
-CountryData::Series::~Series() {
-    delete[] years;
+// Swap the value buffer for its compressed copy, unless that would not save anything.
+// A column decoded for a write still has its old copy; only the blocks written since are
+// coded again.
+void CountryData::Column::pack() {
+    if (mapped || values == nullptr || size == 0)
+        return;
+    if (packed.empty())
+        packed.encode(values, validity, size);
+    else
+        packed.encodeFrom(values, validity, size, dirtyFrom / 64);
+    dirtyFrom = size;
+    if (packed.bytes() >= (size_t)capacity * sizeof(double)) {
+        packed.clear();
+        return;
+    }
     delete[] values;
-    years = nullptr;
     values = nullptr;
 }
 
-void CountryData::Series::resize() {
-    int newMax = maxEntries * 2;
-    int *newYears = new int[newMax];
-    double *newValues = new double[newMax];
-    for (int i = 0; i < newMax; i++) {
-        newYears[i] = 0;
-        newValues[i] = 0.0;
+double CountryData::Column::BlockCursor::at(int index) {
+    if (col->values != nullptr)
+        return col->values[index];
+    if ((index >> 6) != decoded) {
+        decoded = index >> 6;
+        col->packed.decodeBlock(decoded, col->validity, block);
     }
-    for (int i = 0; i < numEntries; i++) {
-        newYears[i] = years[i];
-        newValues[i] = values[i];
+    return block[index & 63];
+}
+
+// Append one value (reserve() must already have made room). Missing values are stored
+// as 0.0 with their validity bit clear.
+void CountryData::Column::append(double value, bool valid) {
+    if (size < dirtyFrom)
+        dirtyFrom = size;
+    uint64_t bit = 1ULL << (size & 63);
+    if (valid) {
+        values[size] = value;
+        validity[size >> 6] |= bit;
+    } else {
+        values[size] = 0.0;
+        validity[size >> 6] &= ~bit;
+    }
+    size++;
+}
+
+// Overwrite the value at 'index' with real data.
+void CountryData::Column::set(int index, double value) {
+    if (index < dirtyFrom)
+        dirtyFrom = index;
+    values[index] = value;
+    validity[index >> 6] |= 1ULL << (index & 63);
+}
+
+bool CountryData::Column::isValid(int index) const {
+    return (validity[index >> 6] >> (index & 63)) & 1;
+}
+
+// Parse one row's value fields into values/validity from index 'at' on, as appendRow would
+// append them. The validity bits there must start clear.
+static void parseFields(std::string_view fields, double *values, uint64_t *validity, int at) {
+    std::string_view val;
+    while (CsvCursor::nextField(fields, val)) {
+        double value;
+        if (CsvCursor::parseValue(val, value)) {
+            values[at] = value;
+            validity[at >> 6] |= 1ULL << (at & 63);
+        } else {
+            values[at] = 0.0;
+        }
+        at++;
+    }
+}
+
+// Remember a row whose values will go at 'offset' (rows come in increasing offset order).
+void CountryData::Column::addTextRow(std::string_view fields, int offset) {
+    if (numTextRows >= maxTextRows) {
+        int newMax = (maxTextRows == 0) ? 64 : maxTextRows * 2;
+        TextRow *newRows = new TextRow[newMax];
+        if (numTextRows > 0)
+            memcpy(newRows, textRows, numTextRows * sizeof(TextRow));
+        delete[] textRows;
+        textRows = newRows;
+        maxTextRows = newMax;
+    }
+    TextRow &row = textRows[numTextRows++];
+    row.fields = fields.data();
+    row.length = fields.size();
+    row.offset = offset;
+}
+
+void CountryData::Column::parseText(double *out, uint64_t *outValidity) const {
+    for (int i = 0; i < numTextRows; i++)
+        parseFields(std::string_view(textRows[i].fields, textRows[i].length), out, outValidity, textRows[i].offset);
+}
+
+// The text row whose values start at 'offset', or nullptr.
+const CountryData::Column::TextRow *CountryData::Column::findTextRow(int offset) const {
+    const TextRow *begin = textRows;
+    const TextRow *end = textRows + numTextRows;
+    const TextRow *row = std::lower_bound(begin, end, offset,
+                                          [](const TextRow &r, int o) { return r.offset < o; });
+    return (row != end && row->offset == offset) ? row : nullptr;
+}
+
+// Record that country c's series at seriesIndex lives in this column.
+// Returns the ref's position, which the Series keeps so it can be unlinked in O(1).
+int CountryData::Column::addRef(CountryNode *c, int seriesIndex) {
+    if (numRefs >= maxRefs) {
+        int newMax = (maxRefs == 0) ? 16 : maxRefs * 2;
+        SeriesRef *newRefs = new SeriesRef[newMax];
+        for (int i = 0; i < numRefs; i++)
+            newRefs[i] = refs[i];
+        delete[] refs;
+        refs = newRefs;
+        maxRefs = newMax;
+    }
+    refs[numRefs].country = c;
+    refs[numRefs].seriesIndex = seriesIndex;
+    return numRefs++;
+}
+
+// Unlink the ref at 'index' by moving the last ref into its place.
+void CountryData::Column::removeRef(int index) {
+    numRefs--;
+    if (index != numRefs) {
+        refs[index] = refs[numRefs];
+        refs[index].country->series[refs[index].seriesIndex].refIndex = index;
     }
-    delete[] years;
-    delete[] values;
-    years = newYears;
-    values = newValues;
-    maxEntries = newMax;
 }
 
 // COUNTRYNODE IMPLEMENTATION
-CountryData::CountryNode::CountryNode(const std::string &name, const std::string &code)
-    : countryName(name), countryCode(code), timeSeries(nullptr)
+CountryData::CountryNode::CountryNode(std::string_view name, uint32_t id, std::string_view code)
+    : countryName(name), countryCode(code), nameId(id), slot(-1), series(nullptr), numSeries(0), maxSeries(0)
 {
 }
 
-CountryData::CountryNode::~CountryNode() {
-    Series *current = timeSeries;
-    while (current != nullptr) {
-        Series *next = current->next;
-        delete current;
-        current = next;
+// Append an empty Series slot, growing the array when full. The old array goes back to
+// the arena, where the next country to reach that size picks it up.
+CountryData::Series &CountryData::CountryNode::addSeries(Arena &arena) {
+    if (numSeries >= maxSeries) {
+        int newMax = (maxSeries == 0) ? 8 : maxSeries * 2;
+        Series *newSeries = arena.allocateArray<Series>(newMax);
+        if (numSeries > 0)
+            memcpy(newSeries, series, numSeries * sizeof(Series));
+        arena.release(series, maxSeries * sizeof(Series));
+        series = newSeries;
+        maxSeries = newMax;
     }
-    timeSeries = nullptr;
+    Series &s = series[numSeries++];
+    s = Series();
+    return s;
 }
 
 // COUNTRYDATA IMPLEMENTATION 
 CountryData::CountryData() 
-    : countryCount(0), buildEntries(nullptr), buildSize(0), buildCapacity(0), lastBuiltSeries("")
+    : strings(arena), countryCount(0), buildCacheCount(0), buildClock(0),
+      nameIndex(nullptr), nameStatus(nullptr), nameIndexSize(0), nameIndexUsed(0),
+      loadThreads(1), buildThreads(1), lazyLoad(false), columns(nullptr), columnCount(0), columnCapacity(0),
+      columnIndex(nullptr), columnIndexSize(0)
 {
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        countryArray[i] = nullptr;
-        slotStatus[i] = STATUS_EMPTY;
-    }
+    allocateTable(FIRST_TABLE_SIZE);
+    allocateNameIndex(INITIAL_TABLE_SIZE);
 }
 
 
 CountryData::~CountryData() {
     // Clean up hash table
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        if (countryArray[i] != nullptr) {
-            delete countryArray[i];
-            countryArray[i] = nullptr;
-        }
-        slotStatus[i] = STATUS_EMPTY;
-    }
-    countryCount = 0;
-    deleteBuildEntries();
+    clearTable();
+    freeTable();
+    delete[] nameIndex;
+    delete[] nameStatus;
+    nameIndex = nullptr;
+    nameStatus = nullptr;
+    clearColumns();
+    closeSnapshot();
+    closeLoadFile();
+    clearBuilds();
 }
 
 // Hashing Helper Methods
-unsigned int CountryData::codeToInteger(const std::string &code) const {
-    unsigned int val = 0;
-    for (int i = 0; i < 3; i++) {
-        unsigned int letterVal = (unsigned int)(code[i] - 'A');
-        val = val * 26 + letterVal;
+// Only for codes already checked with codeKey(); the table never holds any other kind.
+unsigned int CountryData::codeToInteger(std::string_view code) const {
+    return (unsigned int)codeKey(code);
+}
+
+// Allocate an empty table with 'size' slots (size must be a power of two).
+void CountryData::allocateTable(int size) {
+    tableSize = size;
+    countryArray = new CountryNode*[tableSize];
+    slotStatus = new int[tableSize];
+#ifdef COUNTRYDATA_SWISS_TABLE
+    control = new uint8_t[tableSize];
+#endif
+    for (int i = 0; i < tableSize; i++)
+        setSlot(i, nullptr, STATUS_EMPTY);
+    countryCount = 0;
+    tombstoneCount = 0;
+}
+
+// Free the slot arrays (the countries must already be gone or moved elsewhere).
+void CountryData::freeTable() {
+    delete[] countryArray;
+    delete[] slotStatus;
+    countryArray = nullptr;
+    slotStatus = nullptr;
+#ifdef COUNTRYDATA_SWISS_TABLE
+    delete[] control;
+    control = nullptr;
+#endif
+}
+
+// Drop every country and mark all slots empty (the table keeps its size). The countries
+// are not freed one by one: the arena they live in is reset.
+void CountryData::clearTable() {
+    for (int i = 0; i < tableSize; i++)
+        setSlot(i, nullptr, STATUS_EMPTY);
+    arena.reset();
+    strings.clear();
+    // The active build's code outlives a LOAD (see clearBuilds); its old id is gone with
+    // the pool, and getColumn hands it the new one.
+    setBuildCode(build, build.seriesCode);
+    countryCount = 0;
+    tombstoneCount = 0;
+    for (int i = 0; i < nameIndexSize; i++) {
+        nameIndex[i] = nullptr;
+        nameStatus[i] = STATUS_EMPTY;
+    }
+    nameIndexUsed = 0;
+}
+
+// Rebuild the table with 'newSize' slots. Every country is re-placed under the new
+// hash and all tombstones disappear. Used both to grow and to clean up in place.
+void CountryData::rehash(int newSize) {
+    CountryNode **oldArray = countryArray;
+    int *oldStatus = slotStatus;
+    int oldSize = tableSize;
+#ifdef COUNTRYDATA_SWISS_TABLE
+    uint8_t *oldControl = control;
+#endif
+    allocateTable(newSize);
+    for (int i = 0; i < oldSize; i++) {
+        if (oldStatus[i] == STATUS_OCCUPIED && oldArray[i] != nullptr)
+            placeNode(oldArray[i]);
     }
-    return val;
+    delete[] oldArray;
+    delete[] oldStatus;
+#ifdef COUNTRYDATA_SWISS_TABLE
+    delete[] oldControl;
+#endif
+}
+
+// Slot bookkeeping shared by both probing schemes: the status array, and in a swiss
+// table the control byte, always agree with what the slot holds.
+void CountryData::setSlot(unsigned int pos, CountryNode *node, int status) {
+    countryArray[pos] = node;
+    slotStatus[pos] = status;
+    if (status == STATUS_OCCUPIED)
+        node->slot = (int)pos;
+#ifdef COUNTRYDATA_SWISS_TABLE
+    if (status == STATUS_OCCUPIED)
+        control[pos] = fingerprint(swissHash(codeToInteger(node->countryCode)));
+    else
+        control[pos] = (status == STATUS_PREV_OCCUPIED) ? CTRL_DELETED : CTRL_EMPTY;
+#endif
+}
+
+// Take the country at 'pos' out of the table and free it, leaving a tombstone.
+void CountryData::removeSlot(unsigned int pos) {
+    releaseSeries(countryArray[pos]);
+    nameIndexRemove(countryArray[pos]);
+    freeCountry(countryArray[pos]);
+#ifdef COUNTRYDATA_DIRECT_TABLE
+    // No probe sequence passes through a direct slot, so it is simply empty again.
+    setSlot(pos, nullptr, STATUS_EMPTY);
+    countryCount--;
+#else
+    setSlot(pos, nullptr, STATUS_PREV_OCCUPIED);
+    countryCount--;
+    tombstoneCount++;
+    // Too many tombstones make every miss walk long chains; clean them up.
+    if (tombstoneCount > tableSize * MAX_TOMBSTONE_RATIO)
+        rehash(tableSize);
+#endif
+}
+
+// Countries are placed in the arena along with a copy of their code; the name is interned.
+CountryData::CountryNode *CountryData::newCountry(std::string_view name, std::string_view code) {
+    uint32_t nameId = strings.intern(name);
+    void *p = arena.allocate(sizeof(CountryNode), alignof(CountryNode));
+    return new (p) CountryNode(strings.get(nameId), nameId, arena.copy(code));
+}
+
+// Return a country's node and series array to the arena for reuse. Its names stay
+// behind until the next reset.
+void CountryData::freeCountry(CountryNode *c) {
+    arena.release(c->series, c->maxSeries * sizeof(Series));
+    arena.release(c, sizeof(CountryNode));
+}
+
+#if defined(COUNTRYDATA_DIRECT_TABLE)
+// Direct addressing: the slot of a code is its key, so every operation reads one slot.
+// A code that is not three letters A-Z has no slot and is never found or stored.
+void CountryData::placeNode(CountryNode *node) {
+    setSlot(codeToInteger(node->countryCode), node, STATUS_OCCUPIED);
+    countryCount++;
+}
+
+bool CountryData::hashInsert(CountryNode *newCountry) {
+    int key = codeKey(newCountry->countryCode);
+    if (key < 0)
+        return false;
+    STATS_PROBES(insert, 1);
+    if (slotStatus[key] == STATUS_OCCUPIED)
+        return false;
+    setSlot((unsigned int)key, newCountry, STATUS_OCCUPIED);
+    countryCount++;
+    nameIndexInsert(newCountry);
+    return true;
+}
+
+std::pair<int,int> CountryData::hashSearch(std::string_view code) const {
+    int key = codeKey(code);
+    if (key < 0)
+        return std::make_pair(-1, 0);
+    STATS_PROBES(search, 1);
+    if (slotStatus[key] != STATUS_OCCUPIED)
+        return std::make_pair(-1, 1);
+    return std::make_pair(key, 1);
 }
 
+bool CountryData::hashRemove(std::string_view code) {
+    int key = codeKey(code);
+    if (key < 0)
+        return false;
+    STATS_PROBES(remove, 1);
+    if (slotStatus[key] != STATUS_OCCUPIED)
+        return false;
+    removeSlot((unsigned int)key);
+    return true;
+}
+#elif !defined(COUNTRYDATA_SWISS_TABLE)
 unsigned int CountryData::h1(unsigned int W) const {
-    return W % MAX_COUNTRIES;
+    return W % tableSize;
 }
 
 unsigned int CountryData::h2(unsigned int W) const {
-    unsigned int temp = W / MAX_COUNTRIES;
-    unsigned int step = temp % MAX_COUNTRIES;
+    unsigned int temp = W / tableSize;
+    // Codes stay below 26^3, so once the table has grown W / tableSize only takes a
+    // handful of values; scramble W instead so steps stay spread out.
+    if (tableSize > INITIAL_TABLE_SIZE)
+        temp = (W * 2654435761u) >> 12;
+    unsigned int step = temp % tableSize;
+    // tableSize is always a power of two, so any odd step visits every slot.
     if (step % 2 == 0)
         step += 1;
     return step;
 }
 
+// Probe for the first free slot of a code that is known not to be in the table.
+void CountryData::placeNode(CountryNode *node) {
+    unsigned int W = codeToInteger(node->countryCode);
+    unsigned int index = h1(W);
+    unsigned int step = h2(W);
+    for (int i = 0; i < tableSize; i++) {
+        unsigned int pos = (index + i * step) % tableSize;
+        if (slotStatus[pos] != STATUS_OCCUPIED) {
+            if (slotStatus[pos] == STATUS_PREV_OCCUPIED)
+                tombstoneCount--;
+            setSlot(pos, node, STATUS_OCCUPIED);
+            countryCount++;
+            return;
+        }
+    }
+}
+
 bool CountryData::hashInsert(CountryNode *newCountry) {
-    std::string code = newCountry->countryCode;
+    // Grow once live countries pass the load factor; if it is mostly tombstones
+    // that fill the table, a same-size rehash is enough to shorten the probes.
+    if ((countryCount + 1) > tableSize * MAX_LOAD_FACTOR)
+        rehash(tableSize * 2);
+    else if ((countryCount + tombstoneCount + 1) > tableSize * MAX_LOAD_FACTOR)
+        rehash(tableSize);
+
+    std::string_view code = newCountry->countryCode;
+    if (codeKey(code) < 0)
+        return false;
     unsigned int W = codeToInteger(code);
     unsigned int index = h1(W);
     unsigned int step = h2(W);
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        unsigned int pos = (index + i * step) % MAX_COUNTRIES;
+    for (int i = 0; i < tableSize; i++) {
+        unsigned int pos = (index + i * step) % tableSize;
         if (slotStatus[pos] == STATUS_OCCUPIED) {
-            if (countryArray[pos]->countryCode == code)
+            if (countryArray[pos]->countryCode == code) {
+                STATS_PROBES(insert, i + 1);
                 return false;
+            }
         } else if (slotStatus[pos] == STATUS_EMPTY || slotStatus[pos] == STATUS_PREV_OCCUPIED) {
-            countryArray[pos] = newCountry;
-            slotStatus[pos] = STATUS_OCCUPIED;
+            STATS_PROBES(insert, i + 1);
+            if (slotStatus[pos] == STATUS_PREV_OCCUPIED)
+                tombstoneCount--;
+            setSlot(pos, newCountry, STATUS_OCCUPIED);
             countryCount++;
+            nameIndexInsert(newCountry);
             return true;
         }
     }
+    STATS_PROBES(insert, tableSize);
     return false;
 }
 
-std::pair<int,int> CountryData::hashSearch(const std::string &code) const {
+std::pair<int,int> CountryData::hashSearch(std::string_view code) const {
+    if (codeKey(code) < 0)
+        return std::make_pair(-1, 0);
     unsigned int W = codeToInteger(code);
     unsigned int index = h1(W);
     unsigned int step = h2(W);
     int probes = 0;
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        unsigned int pos = (index + i * step) % MAX_COUNTRIES;
+    for (int i = 0; i < tableSize; i++) {
+        unsigned int pos = (index + i * step) % tableSize;
         probes++;
         if (slotStatus[pos] == STATUS_OCCUPIED && countryArray[pos] != nullptr) {
-            if (countryArray[pos]->countryCode == code)
+            if (countryArray[pos]->countryCode == code) {
+                STATS_PROBES(search, probes);
                 return std::make_pair((int)pos, probes);
+            }
         } else if (slotStatus[pos] == STATUS_EMPTY) {
+            STATS_PROBES(search, probes);
             return std::make_pair(-1, probes);
         }
     }
+    STATS_PROBES(search, probes);
     return std::make_pair(-1, probes);
 }
 
-bool CountryData::hashRemove(const std::string &code) {
+bool CountryData::hashRemove(std::string_view code) {
+    if (codeKey(code) < 0)
+        return false;
     unsigned int W = codeToInteger(code);
     unsigned int index = h1(W);
     unsigned int step = h2(W);
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        unsigned int pos = (index + i * step) % MAX_COUNTRIES;
+    for (int i = 0; i < tableSize; i++) {
+        unsigned int pos = (index + i * step) % tableSize;
         if (slotStatus[pos] == STATUS_OCCUPIED && countryArray[pos] != nullptr) {
             if (countryArray[pos]->countryCode == code) {
-                delete countryArray[pos];
-                countryArray[pos] = nullptr;
-                slotStatus[pos] = STATUS_PREV_OCCUPIED;
-                countryCount--;
+                STATS_PROBES(remove, i + 1);
+                removeSlot(pos);
                 return true;
             }
         } else if (slotStatus[pos] == STATUS_EMPTY) {
+            STATS_PROBES(remove, i + 1);
             return false;
         }
     }
+    STATS_PROBES(remove, tableSize);
     return false;
 }
+#else
+// Swiss table probing. A code's groups are visited in triangular order (g, g+1, g+3, ...),
+// which covers every group since their count is a power of two. A search stops at the
+// first group with an empty slot; the probe count is the number of groups read.
+void CountryData::placeNode(CountryNode *node) {
+    uint64_t hash = swissHash(codeToInteger(node->countryCode));
+    unsigned int mask = (unsigned int)(tableSize / GROUP_SLOTS) - 1;
+    unsigned int group = (unsigned int)(hash >> 32) & mask;
+    for (unsigned int i = 1; i <= mask + 1; i++) {
+        unsigned int free = matchFree(control + group * GROUP_SLOTS);
+        if (free != 0) {
+            unsigned int pos = group * GROUP_SLOTS + __builtin_ctz(free);
+            if (slotStatus[pos] == STATUS_PREV_OCCUPIED)
+                tombstoneCount--;
+            setSlot(pos, node, STATUS_OCCUPIED);
+            countryCount++;
+            return;
+        }
+        group = (group + i) & mask;
+    }
+}
 
-// Other commands
-void CountryData::deleteBuildEntries() {
-    if (buildEntries != nullptr) {
-        for (int i = 0; i < buildSize; i++) {
-            delete buildEntries[i];
-        }
-        delete[] buildEntries;
-        buildEntries = nullptr;
-        buildSize = 0;
-        buildCapacity = 0;
-    }
-}
-
-bool CountryData::buildStructure(const std::string &seriesCode) {
-    deleteBuildEntries();
-    int capacity = countryCount;
-    buildCapacity = (capacity > 0) ? capacity : 1;
-    buildEntries = new Entry*[buildCapacity];
-    for (int i = 0; i < buildCapacity; i++)
-        buildEntries[i] = nullptr;
-    buildSize = 0;
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        if (slotStatus[i] == STATUS_OCCUPIED && countryArray[i] != nullptr) {
-            CountryNode *c = countryArray[i];
-            Series *s = c->timeSeries;
-            bool found = false;
-            double sum = 0.0;
-            int validCount = 0;
-            while (s != nullptr) {
-                if (s->seriesCode == seriesCode) {
-                    found = true;
-                    for (int j = 0; j < s->numEntries; j++) {
-                        if (s->values[j] != -1) {
-                            sum += s->values[j];
-                            validCount++;
-                        }
-                    }
-                    break;
-                }
-                s = s->next;
+bool CountryData::hashInsert(CountryNode *newCountry) {
+    // Same growth policy as the double-hashing table.
+    if ((countryCount + 1) > tableSize * MAX_LOAD_FACTOR)
+        rehash(tableSize * 2);
+    else if ((countryCount + tombstoneCount + 1) > tableSize * MAX_LOAD_FACTOR)
+        rehash(tableSize);
+
+    std::string_view code = newCountry->countryCode;
+    if (codeKey(code) < 0)
+        return false;
+    uint64_t hash = swissHash(codeToInteger(code));
+    uint8_t fp = fingerprint(hash);
+    unsigned int mask = (unsigned int)(tableSize / GROUP_SLOTS) - 1;
+    unsigned int group = (unsigned int)(hash >> 32) & mask;
+    int target = -1;
+    int probes = 0;
+    for (unsigned int i = 1; i <= mask + 1; i++) {
+        const uint8_t *ctrl = control + group * GROUP_SLOTS;
+        probes++;
+        for (unsigned int m = matchByte(ctrl, fp); m != 0; m &= m - 1) {
+            if (countryArray[group * GROUP_SLOTS + __builtin_ctz(m)]->countryCode == code) {
+                STATS_PROBES(insert, probes);
+                return false;
             }
-            if (found) {
-                double mean = (validCount > 0) ? (sum / validCount) : 0.0;
-                Entry *e = new Entry();
-                e->countryName = c->countryName;
-                e->mean = mean;
-                buildEntries[buildSize++] = e;
+        }
+        // Take the first free slot, but keep going to the end of the chain for duplicates.
+        unsigned int free = matchFree(ctrl);
+        if (target < 0 && free != 0)
+            target = (int)(group * GROUP_SLOTS + __builtin_ctz(free));
+        if (matchByte(ctrl, CTRL_EMPTY) != 0)
+            break;
+        group = (group + i) & mask;
+    }
+    STATS_PROBES(insert, probes);
+    if (target < 0)
+        return false;
+    if (slotStatus[target] == STATUS_PREV_OCCUPIED)
+        tombstoneCount--;
+    setSlot((unsigned int)target, newCountry, STATUS_OCCUPIED);
+    countryCount++;
+    nameIndexInsert(newCountry);
+    return true;
+}
+
+std::pair<int,int> CountryData::hashSearch(std::string_view code) const {
+    if (codeKey(code) < 0)
+        return std::make_pair(-1, 0);
+    uint64_t hash = swissHash(codeToInteger(code));
+    uint8_t fp = fingerprint(hash);
+    unsigned int mask = (unsigned int)(tableSize / GROUP_SLOTS) - 1;
+    unsigned int group = (unsigned int)(hash >> 32) & mask;
+    int probes = 0;
+    for (unsigned int i = 1; i <= mask + 1; i++) {
+        const uint8_t *ctrl = control + group * GROUP_SLOTS;
+        probes++;
+        for (unsigned int m = matchByte(ctrl, fp); m != 0; m &= m - 1) {
+            unsigned int pos = group * GROUP_SLOTS + __builtin_ctz(m);
+            if (countryArray[pos]->countryCode == code) {
+                STATS_PROBES(search, probes);
+                return std::make_pair((int)pos, probes);
             }
         }
+        if (matchByte(ctrl, CTRL_EMPTY) != 0)
+            break;
+        group = (group + i) & mask;
     }
-    return (buildSize > 0);
+    STATS_PROBES(search, probes);
+    return std::make_pair(-1, probes);
 }
 
-bool CountryData::buildCommand(const std::string &seriesCode) {
-    bool built = buildStructure(seriesCode);
-    // Record the series code used for BUILD.
-    lastBuiltSeries = seriesCode;
-    return built; 
+bool CountryData::hashRemove(std::string_view code) {
+    std::pair<int,int> sr = hashSearch(code);
+    if (sr.first == -1)
+        return false;
+    STATS_PROBES(remove, sr.second);
+    removeSlot((unsigned int)sr.first);
+    return true;
+}
+#endif
+
+// Name Index Helper Methods
+// A second open-addressed table (linear probing) from country name to CountryNode, so
+// LIST and DELETE do not scan countryArray. It follows hashInsert/hashRemove exactly.
+// It is keyed by interned name id: a lookup finds the id once, then probes compare ids.
+unsigned int CountryData::nameHash(uint32_t nameId) const {
+    return (nameId * 2654435761u) >> 8;
+}
+
+void CountryData::allocateNameIndex(int size) {
+    nameIndexSize = size;
+    nameIndex = new CountryNode*[nameIndexSize];
+    nameStatus = new int[nameIndexSize];
+    for (int i = 0; i < nameIndexSize; i++) {
+        nameIndex[i] = nullptr;
+        nameStatus[i] = STATUS_EMPTY;
+    }
+    nameIndexUsed = 0;
+}
+
+// Rebuild the name index with 'newSize' slots, dropping its tombstones.
+void CountryData::rehashNameIndex(int newSize) {
+    CountryNode **oldIndex = nameIndex;
+    int *oldStatus = nameStatus;
+    int oldSize = nameIndexSize;
+    allocateNameIndex(newSize);
+    for (int i = 0; i < oldSize; i++) {
+        if (oldStatus[i] == STATUS_OCCUPIED)
+            nameIndexInsert(oldIndex[i]);
+    }
+    delete[] oldIndex;
+    delete[] oldStatus;
+}
+
+void CountryData::nameIndexInsert(CountryNode *node) {
+    // Same policy as the code table: grow on live entries, otherwise clear tombstones.
+    if ((countryCount + 1) > nameIndexSize * MAX_LOAD_FACTOR)
+        rehashNameIndex(nameIndexSize * 2);
+    else if ((nameIndexUsed + 1) > nameIndexSize * MAX_LOAD_FACTOR)
+        rehashNameIndex(nameIndexSize);
+    unsigned int mask = (unsigned int)nameIndexSize - 1;
+    unsigned int pos = nameHash(node->nameId) & mask;
+    while (nameStatus[pos] == STATUS_OCCUPIED)
+        pos = (pos + 1) & mask;
+    if (nameStatus[pos] == STATUS_EMPTY)
+        nameIndexUsed++;
+    nameIndex[pos] = node;
+    nameStatus[pos] = STATUS_OCCUPIED;
+}
+
+void CountryData::nameIndexRemove(CountryNode *node) {
+    unsigned int mask = (unsigned int)nameIndexSize - 1;
+    unsigned int pos = nameHash(node->nameId) & mask;
+    while (nameStatus[pos] != STATUS_EMPTY) {
+        if (nameStatus[pos] == STATUS_OCCUPIED && nameIndex[pos] == node) {
+            nameIndex[pos] = nullptr;
+            nameStatus[pos] = STATUS_PREV_OCCUPIED;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+// Find a country by name. Names need not be unique; like a scan of countryArray,
+// the match in the lowest slot wins.
+CountryData::CountryNode *CountryData::nameIndexFind(const std::string &name) const {
+    uint32_t nameId = strings.find(name);
+    if (nameId == StringPool::NO_STRING)
+        return nullptr;
+    unsigned int mask = (unsigned int)nameIndexSize - 1;
+    unsigned int pos = nameHash(nameId) & mask;
+    CountryNode *best = nullptr;
+    while (nameStatus[pos] != STATUS_EMPTY) {
+        if (nameStatus[pos] == STATUS_OCCUPIED && nameIndex[pos]->nameId == nameId) {
+            if (best == nullptr || nameIndex[pos]->slot < best->slot)
+                best = nameIndex[pos];
+        }
+        pos = (pos + 1) & mask;
+    }
+    return best;
+}
+
+// BUILDTABLE IMPLEMENTATION
+CountryData::BuildTable::BuildTable()
+    : seriesCode(""), codeId(StringPool::NO_STRING), fromYear(0), toYear(0), kind(AGG_MEAN), entries(nullptr), size(0), capacity(0),
+      lastUsed(0), complete(false)
+{
+}
+
+CountryData::BuildTable::~BuildTable() {
+    clear();
+}
+
+// Free every entry and the array itself.
+void CountryData::BuildTable::clear() {
+    if (entries != nullptr) {
+        for (int i = 0; i < size; i++) {
+            delete entries[i];
+        }
+        delete[] entries;
+        entries = nullptr;
+        size = 0;
+        capacity = 0;
+    }
+}
+
+// Exchange contents with another table; moving builds in and out of the cache is pointer swaps.
+void CountryData::BuildTable::swap(BuildTable &other) {
+    std::swap(seriesCode, other.seriesCode);
+    std::swap(codeId, other.codeId);
+    std::swap(fromYear, other.fromYear);
+    std::swap(toYear, other.toYear);
+    std::swap(kind, other.kind);
+    std::swap(entries, other.entries);
+    std::swap(size, other.size);
+    std::swap(capacity, other.capacity);
+    std::swap(lastUsed, other.lastUsed);
+    std::swap(complete, other.complete);
+}
+
+bool CountryData::BuildTable::sameKey(const std::string &code, int from, int to, AggregateKind k) const {
+    return seriesCode == code && fromYear == from && toYear == to && kind == k;
+}
+
+// Build array order: ascending mean, then country name, so output is deterministic.
+bool CountryData::BuildTable::entryLess(const Entry *a, const Entry *b) {
+    if (a->mean != b->mean)
+        return a->mean < b->mean;
+    return a->countryName < b->countryName;
+}
+
+// Index of the first entry whose mean is >= value (size if none).
+int CountryData::BuildTable::lowerBoundMean(double value) const {
+    Entry **it = std::lower_bound(entries, entries + size, value,
+                                  [](const Entry *e, double v) { return e->mean < v; });
+    return (int)(it - entries);
+}
+
+// Index of the first entry whose mean is > value (size if none).
+int CountryData::BuildTable::upperBoundMean(double value) const {
+    Entry **it = std::upper_bound(entries, entries + size, value,
+                                  [](double v, const Entry *e) { return v < e->mean; });
+    return (int)(it - entries);
+}
+
+// Insert an entry at its sorted position, growing the array if needed.
+void CountryData::BuildTable::insert(Entry *e) {
+    if (entries == nullptr) {
+        capacity = 1;
+        entries = new Entry*[capacity];
+        size = 0;
+    } else if (size >= capacity) {
+        // Reallocate: double the capacity.
+        int newCapacity = (capacity == 0 ? 1 : capacity * 2);
+        Entry **newEntries = new Entry*[newCapacity];
+        for (int i = 0; i < size; i++) {
+            newEntries[i] = entries[i];
+        }
+        delete[] entries;
+        entries = newEntries;
+        capacity = newCapacity;
+    }
+    Entry **pos = std::upper_bound(entries, entries + size, e, entryLess);
+    int index = (int)(pos - entries);
+    memmove(entries + index + 1, entries + index, (size - index) * sizeof(Entry *));
+    entries[index] = e;
+    size++;
+}
+
+// Unlink the entry matching 'key' (a country's name and the value its entry should have)
+// and hand it back, or nullptr if there is none.
+CountryData::Entry *CountryData::BuildTable::take(const Entry &key) {
+    Entry **pos = std::lower_bound(entries, entries + size, &key, entryLess);
+    if (pos == entries + size || (*pos)->mean != key.mean || (*pos)->nameId != key.nameId)
+        return nullptr;
+    Entry *e = *pos;
+    int index = (int)(pos - entries);
+    memmove(entries + index, entries + index + 1, (size - index - 1) * sizeof(Entry *));
+    size--;
+    return e;
+}
+
+// Remove a country's entries. key.mean is where the country's entry should sit; if nothing
+// is there, fall back to scanning by name.
+bool CountryData::BuildTable::remove(const Entry &key) {
+    std::pair<Entry **, Entry **> range = std::equal_range(entries, entries + size, &key, entryLess);
+    int from = (int)(range.first - entries);
+    int to = (int)(range.second - entries);
+    if (from == to)
+        return removeName(key.nameId);
+    for (int i = from; i < to; i++)
+        delete entries[i];
+    memmove(entries + from, entries + to, (size - to) * sizeof(Entry *));
+    size -= to - from;
+    return true;
+}
+
+bool CountryData::BuildTable::removeName(uint32_t nameId) {
+    int kept = 0;
+    for (int i = 0; i < size; i++) {
+        if (entries[i]->nameId == nameId)
+            delete entries[i];
+        else
+            entries[kept++] = entries[i];
+    }
+    bool found = (kept != size);
+    size = kept;
+    return found;
+}
+
+// Other commands
+bool CountryData::buildStructure(const std::string &seriesCode, int fromYear, int toYear,
+                                 AggregateKind kind) {
+    build.clear();
+    setBuildCode(build, seriesCode);
+    build.fromYear = fromYear;
+    build.toYear = toYear;
+    build.kind = kind;
+    build.complete = true;
+    // Room for one entry per ref: the chunks below fill their parts before duplicates
+    // (a country with the code twice) are dropped.
+    Column *col = findColumn(seriesCode);
+    int capacity = std::max(countryCount, (col != nullptr) ? col->numRefs : 0);
+    build.capacity = (capacity > 0) ? capacity : 1;
+    build.entries = new Entry*[build.capacity];
+    for (int i = 0; i < build.capacity; i++)
+        build.entries[i] = nullptr;
+    build.size = 0;
+    if (col == nullptr || col->numRefs == 0)
+        return false;
+    // Anything aggregate() would set up on first use is done here, before any thread reads it.
+    parseColumn(col);
+    if (!(fromYear == 0 && toYear == 0 && kind == AGG_MEAN))
+        ensureWindows(col);
+
+    // Only the countries that carry this series are visited. The slot range is cut into
+    // chunks and each ref is dealt to the chunk its country's slot falls in, so every
+    // chunk can be walked in table order on its own.
+    int threads = (col->numRefs >= MIN_PARALLEL_BUILD_REFS) ? buildThreads : 1;
+    int chunks = (threads > 1) ? threads * BUILD_CHUNKS_PER_THREAD : 1;
+    int *chunkStart = new int[chunks + 1];
+    int *chunkEntries = new int[chunks];
+    for (int k = 0; k <= chunks; k++)
+        chunkStart[k] = 0;
+    for (int i = 0; i < col->numRefs; i++)
+        chunkStart[(int64_t)col->refs[i].country->slot * chunks / tableSize + 1]++;
+    for (int k = 0; k < chunks; k++)
+        chunkStart[k + 1] += chunkStart[k];
+    SeriesRef *order = new SeriesRef[col->numRefs];
+    int *next = new int[chunks];
+    memcpy(next, chunkStart, chunks * sizeof(int));
+    for (int i = 0; i < col->numRefs; i++)
+        order[next[(int64_t)col->refs[i].country->slot * chunks / tableSize]++] = col->refs[i];
+    delete[] next;
+
+    // Chunks go to whichever thread asks next, so a chunk of long series does not hold
+    // the rest back. Each chunk's entries land in its own part of build.entries.
+    std::atomic<int> nextChunk(0);
+    auto work = [&]() {
+        for (int k = nextChunk++; k < chunks; k = nextChunk++) {
+            buildChunk(col, build, order + chunkStart[k], chunkStart[k + 1] - chunkStart[k],
+                       build.entries + chunkStart[k], chunkEntries[k]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+        workers.emplace_back(work);
+    work();
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    delete[] order;
+
+    // Close the gaps between the chunks' sorted runs, then merge neighbouring runs until
+    // one is left. entryLess orders by mean and then by country name, so equal means come
+    // out by name. Only entries equal under it (same mean, two countries with one name)
+    // depend on the merge being stable: it keeps the earlier chunk first, so those stay in
+    // table order exactly as one sort over the whole table would leave them.
+    for (int k = 0; k < chunks; k++) {
+        memmove(build.entries + build.size, build.entries + chunkStart[k], chunkEntries[k] * sizeof(Entry *));
+        chunkStart[k] = build.size;
+        build.size += chunkEntries[k];
+    }
+    chunkStart[chunks] = build.size;
+    for (int width = 1; width < chunks; width *= 2) {
+        for (int k = 0; k + width < chunks; k += 2 * width) {
+            std::inplace_merge(build.entries + chunkStart[k], build.entries + chunkStart[k + width],
+                               build.entries + chunkStart[std::min(k + 2 * width, chunks)],
+                               BuildTable::entryLess);
+        }
+    }
+    for (int k = build.size; k < build.capacity; k++)
+        build.entries[k] = nullptr;
+    delete[] chunkStart;
+    delete[] chunkEntries;
+    return (build.size > 0);
+}
+
+// Build entries for one chunk of refs into out, sorted. The refs are put in table order
+// (and a country's first series with this code first), so that a country with the code
+// twice counts once and ties keep a fixed order.
+void CountryData::buildChunk(Column *col, const BuildTable &t, SeriesRef *refs, int numRefs,
+                             Entry **out, int &numOut) {
+    std::sort(refs, refs + numRefs, [](const SeriesRef &a, const SeriesRef &b) {
+        if (a.country->slot != b.country->slot)
+            return a.country->slot < b.country->slot;
+        return a.seriesIndex < b.seriesIndex;
+    });
+    const CountryNode *previous = nullptr;
+    numOut = 0;
+    for (int i = 0; i < numRefs; i++) {
+        CountryNode *c = refs[i].country;
+        if (c == previous)
+            continue;
+        previous = c;
+        out[numOut++] = newEntry(c, aggregate(col, c->series[refs[i].seriesIndex], t));
+    }
+    std::stable_sort(out, out + numOut, BuildTable::entryLess);
+}
+
+// Append names of active build entries [from, to) to 'result', separated by spaces.
+void CountryData::appendNames(std::string &result, int from, int to) const {
+    for (int i = from; i < to; i++) {
+        if (!result.empty())
+            result += ' ';
+        result += build.entries[i]->countryName;
+    }
+}
+
+// Park the active build in the cache, evicting the least recently used one if it is full.
+// A build that does not cover the whole table (see clearBuilds) is dropped instead.
+void CountryData::cacheActiveBuild() {
+    if (build.seriesCode.empty() || !build.complete) {
+        build.clear();
+        setBuildCode(build, "");
+        return;
+    }
+    int slot = buildCacheCount;
+    if (buildCacheCount < BUILD_CACHE_SIZE) {
+        buildCacheCount++;
+    } else {
+        slot = 0;
+        for (int i = 1; i < BUILD_CACHE_SIZE; i++) {
+            if (buildCache[i].lastUsed < buildCache[slot].lastUsed)
+                slot = i;
+        }
+        buildCache[slot].clear();
+    }
+    buildCache[slot].swap(build);
+    setBuildCode(build, "");
+}
+
+CountryData::Entry *CountryData::newEntry(const CountryNode *c, double mean) const {
+    Entry *e = new Entry();
+    e->countryName = c->countryName;
+    e->nameId = c->nameId;
+    e->mean = mean;
+    return e;
+}
+
+// Set a build's series code along with its id, so builds are matched to columns by
+// comparing ids. The code is only looked up, never interned: a code no column has keeps
+// NO_STRING until getColumn creates that column.
+void CountryData::setBuildCode(BuildTable &t, const std::string &seriesCode) {
+    t.seriesCode = seriesCode;
+    t.codeId = seriesCode.empty() ? StringPool::NO_STRING : strings.find(seriesCode);
+}
+
+// Drop the active build and every cached one. The active series code is kept, as
+// LOAD always has: a later INSERT still feeds the (now empty) build for that code,
+// but it no longer covers every country, so it is never cached or reused by BUILD.
+void CountryData::clearBuilds() {
+    build.clear();
+    build.complete = false;
+    for (int i = 0; i < buildCacheCount; i++) {
+        buildCache[i].clear();
+        setBuildCode(buildCache[i], "");
+    }
+    buildCacheCount = 0;
+}
+
+// A new country arrived: add its entry to the active build and to every cached build.
+void CountryData::addToBuilds(const CountryNode *c) {
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        if (t.seriesCode.empty())
+            continue;
+        Column *col = findColumn(t.seriesCode);
+        double value;
+        if (col != nullptr && seriesValue(c, col, t, value))
+            t.insert(newEntry(c, value));
+    }
+}
+
+// A country is about to leave the table: drop its entry from the active build and from
+// every cached build, while its series are still there to say where each entry sits.
+void CountryData::removeFromBuilds(const CountryNode *c) {
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        if (t.size == 0)
+            continue;
+        Column *col = findColumn(t.seriesCode);
+        double value;
+        if (col != nullptr && seriesValue(c, col, t, value)) {
+            Entry key = { c->countryName, c->nameId, value };
+            t.remove(key);
+        }
+    }
+}
+
+// Country c has just gained its first series in col: give it an entry in every build
+// of that series code.
+void CountryData::addSeriesToBuilds(const CountryNode *c, Column *col) {
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        double value;
+        if (t.codeId != col->codeId || !seriesValue(c, col, t, value))
+            continue;
+        t.insert(newEntry(c, value));
+    }
+}
+
+// Country c's series in col is about to change: lift its entry out of every build of that
+// series code while the entry's value still says where it sits. Builds without an entry
+// for c (one fed only by INSERTs) leave a nullptr.
+void CountryData::takeFromBuilds(const CountryNode *c, Column *col, Entry **taken) {
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        double value;
+        taken[i + 1] = nullptr;
+        if (t.codeId == col->codeId && seriesValue(c, col, t, value)) {
+            Entry key = { c->countryName, c->nameId, value };
+            taken[i + 1] = t.take(key);
+        }
+    }
+}
+
+// The change is done: put the lifted entries back at their new values.
+void CountryData::putBackInBuilds(const CountryNode *c, Column *col, Entry **taken) {
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        Entry *e = taken[i + 1];
+        if (e == nullptr)
+            continue;
+        seriesValue(c, col, t, e->mean);
+        t.insert(e);
+    }
+}
+
+// Look an aggregate kind up by the name BUILD takes.
+bool CountryData::parseAggregate(const std::string &name, AggregateKind &kind) {
+    static const char *const names[] = { "mean", "min", "max", "count", "stddev" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (name == names[i]) {
+            kind = (AggregateKind)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// BUILD with a window aggregates only the years [fromYear, toYear]; without one
+// (0 and 0), every year.
+bool CountryData::buildCommand(const std::string &seriesCode, int fromYear, int toYear,
+                               AggregateKind kind) {
+    STATS_TIME(STAT_BUILD);
+    if (fromYear > toYear)
+        return false;
+    build.lastUsed = ++buildClock;
+    if (build.sameKey(seriesCode, fromYear, toYear, kind) && build.complete)
+        return (build.size > 0); // kept current by INSERT/REMOVE/DELETE
+    cacheActiveBuild();
+    for (int i = 0; i < buildCacheCount; i++) {
+        if (buildCache[i].sameKey(seriesCode, fromYear, toYear, kind)) {
+            // Cache hit: swap it in and close the gap with the last cached build.
+            build.swap(buildCache[i]);
+            buildCacheCount--;
+            buildCache[i].swap(buildCache[buildCacheCount]);
+            build.lastUsed = buildClock;
+            return (build.size > 0);
+        }
+    }
+    bool built = buildStructure(seriesCode, fromYear, toYear, kind);
+    build.lastUsed = buildClock;
+    return built;
 }
 
 std::string CountryData::computeRange() const {
-    if (buildSize == 0)
+    if (build.size == 0)
         return "failure";
-    double globalMin = buildEntries[0]->mean;
-    double globalMax = buildEntries[0]->mean;
-    for (int i = 1; i < buildSize; i++) {
-        double m = buildEntries[i]->mean;
-        if (m < globalMin) globalMin = m;
-        if (m > globalMax) globalMax = m;
-    }
+    // The build array is sorted by mean, so the range is its two ends.
     std::ostringstream oss;
-    oss << globalMin << " " << globalMax;
+    oss << build.entries[0]->mean << " " << build.entries[build.size - 1]->mean;
     return oss.str();
 }
 
-std::string CountryData::rangeCommand(const std::string &seriesCode) {
+std::string CountryData::rangeCommand(const std::string &seriesCode) const {
+    STATS_TIME(STAT_RANGE);
     // assume BUILD was called before.
     return computeRange();
 }
 
 std::string CountryData::computeFind(double mean, const std::string &op) const {
-    if (buildSize == 0)
+    if (build.size == 0)
         return "failure";
     std::string result;
-    for (int i = 0; i < buildSize; i++) {
-        double m = buildEntries[i]->mean;
-        bool match = false;
-        if (op == "less")
-            match = (m < mean);
-        else if (op == "greater")
-            match = (m > mean);
-        else if (op == "equal")
-            match = (fabs(m - mean) < 0.001);
-        if (match)
-            result += buildEntries[i]->countryName + " ";
-    }
-    if (!result.empty() && result.back() == ' ')
-        result.pop_back();
+    if (op == "less") {
+        appendNames(result, 0, build.lowerBoundMean(mean));
+    } else if (op == "greater") {
+        appendNames(result, build.upperBoundMean(mean), build.size);
+    } else if (op == "equal") {
+        // Binary search narrows it to the window, the exact tolerance test decides the edges.
+        int to = build.upperBoundMean(mean + 0.001);
+        for (int i = build.lowerBoundMean(mean - 0.001); i < to; i++) {
+            if (fabs(build.entries[i]->mean - mean) < 0.001)
+                appendNames(result, i, i + 1);
+        }
+    }
     return result.empty() ? "failure" : result;
 }
 
-std::string CountryData::findCommand(double mean, const std::string &op) {
+std::string CountryData::findCommand(double mean, const std::string &op) const {
+    STATS_TIME(STAT_FIND);
     return computeFind(mean, op);
 }
 
-bool CountryData::deleteFromBuild(const std::string &countryName) {
-    bool found = false;
-    for (int i = 0; i < buildSize; ) {
-        if (buildEntries[i]->countryName == countryName) {
-            delete buildEntries[i];
-            for (int j = i; j < buildSize - 1; j++) {
-                buildEntries[j] = buildEntries[j+1];
-            }
-            buildSize--;
-            found = true;
-        } else {
-            i++;
-        }
-    }
-    return found;
-}
-
 bool CountryData::deleteCommand(const std::string &countryName) {
-    // Search the hash table for the country
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        if (slotStatus[i] == STATUS_OCCUPIED && countryArray[i] != nullptr) {
-            if (countryArray[i]->countryName == countryName) {
-                // Found in the hash table => remove from hash table
-                std::string code = countryArray[i]->countryCode;
-                bool removed = hashRemove(code);  // Must be true if we found it
-                // Also remove from build array
-                deleteFromBuild(countryName);
-                return removed; // Return success (true) if found in hash
-            }
-        }
-    }
-    
-    // If we get here, the country was not in the hash table => return failure
-    return false;
+    STATS_TIME(STAT_DELETE);
+    // Look the country up by name
+    CountryNode *c = nameIndexFind(countryName);
+    if (c == nullptr)
+        return false; // not in the hash table => return failure
+
+    // Drop it from the builds while its series can still place its entries,
+    // then from the hash table
+    removeFromBuilds(c);
+    return hashRemove(c->countryCode);
 }
 
 std::string CountryData::computeLimits(const std::string &condition) const {
-    if (buildSize == 0)
+    if (build.size == 0)
         return "failure";
-    double extreme = buildEntries[0]->mean;
-    for (int i = 1; i < buildSize; i++) {
-        double m = buildEntries[i]->mean;
-        if (condition == "lowest" && m < extreme)
-            extreme = m;
-        else if (condition == "highest" && m > extreme)
-            extreme = m;
-    }
+    // Ties within 0.001 of the extreme sit next to it at that end of the sorted array.
     std::string result;
-    for (int i = 0; i < buildSize; i++) {
-        if (fabs(buildEntries[i]->mean - extreme) < 0.001)
-            result += buildEntries[i]->countryName + " ";
+    if (condition == "highest") {
+        double extreme = build.entries[build.size - 1]->mean;
+        int from = build.size - 1;
+        while (from > 0 && fabs(build.entries[from - 1]->mean - extreme) < 0.001)
+            from--;
+        appendNames(result, from, build.size);
+    } else {
+        double extreme = build.entries[0]->mean;
+        int to = 1;
+        while (to < build.size && fabs(build.entries[to]->mean - extreme) < 0.001)
+            to++;
+        appendNames(result, 0, to);
     }
-    if (!result.empty() && result.back() == ' ')
-        result.pop_back();
     return result.empty() ? "failure" : result;
 }
 
-std::string CountryData::limitsCommand(const std::string &condition) {
+std::string CountryData::limitsCommand(const std::string &condition) const {
+    STATS_TIME(STAT_LIMITS);
     return computeLimits(condition);
 }
 
-std::string CountryData::findCountry(const std::string &countryName) const {
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        if (slotStatus[i] == STATUS_OCCUPIED && countryArray[i] != nullptr) {
-            if (countryArray[i]->countryName == countryName) {
-                std::ostringstream oss;
-                oss << countryArray[i]->countryName << " " << countryArray[i]->countryCode;
-                for (Series *s = countryArray[i]->timeSeries; s != nullptr; s = s->next)
-                    oss << " " << s->seriesName;
-                return oss.str();
-            }
-        }
+// The build array is sorted by mean, so the top k are its last or first k entries and
+// are read in place: no selection pass, and no entry or name is copied before output.
+std::string CountryData::computeTopK(int k, const std::string &condition) const {
+    if (build.size == 0 || k <= 0)
+        return "failure";
+    int n = std::min(k, build.size);
+    std::string result;
+    if (condition == "highest") {
+        for (int i = build.size - 1; i >= build.size - n; i--)
+            appendNames(result, i, i + 1);
+    } else if (condition == "lowest") {
+        appendNames(result, 0, n);
     }
-    return "failure";
+    return result.empty() ? "failure" : result;
+}
+
+std::string CountryData::topkCommand(int k, const std::string &condition) const {
+    STATS_TIME(STAT_TOPK);
+    return computeTopK(k, condition);
+}
+
+// Nearest rank: the smallest value with at least p% of the entries at or below it.
+std::string CountryData::computePercentile(double p) const {
+    if (build.size == 0 || !(p >= 0.0 && p <= 100.0))
+        return "failure";
+    int rank = (int)std::ceil(p / 100.0 * build.size);
+    if (rank < 1)
+        rank = 1;
+    std::ostringstream oss;
+    oss << build.entries[rank - 1]->mean;
+    return oss.str();
+}
+
+std::string CountryData::percentileCommand(double p) const {
+    STATS_TIME(STAT_PERCENTILE);
+    return computePercentile(p);
+}
+
+std::string CountryData::findCountry(const std::string &countryName) const {
+    const CountryNode *c = nameIndexFind(countryName);
+    if (c == nullptr)
+        return "failure";
+    std::ostringstream oss;
+    oss << c->countryName << " " << c->countryCode;
+    for (int j = 0; j < c->numSeries; j++)
+        oss << " " << strings.get(c->series[j].nameId);
+    return oss.str();
 }
 
-std::string CountryData::listCommand(const std::string &countryName) {
+std::string CountryData::listCommand(const std::string &countryName) const {
+    STATS_TIME(STAT_LIST);
     return findCountry(countryName);
 }
 
 // P4 Commands
-bool CountryData::insertCommand(const std::string &code, const std::string &filename) {
-    std::pair<int,int> sr = hashSearch(code);
-    if (sr.first != -1)
-        return false; // Already in table.
-    std::ifstream fin(filename);
-    if (!fin.is_open())
-        return false;
+// Create country 'code' from its rows in the given runs of a mapped CSV (rows of other codes
+// in the runs are skipped), hash it and add it to the builds. False if it has no rows or
+// cannot be hashed.
+bool CountryData::insertRuns(std::string_view code, const char *data, const RowRun *runs, int numRuns) {
     CountryNode *newC = nullptr;
-    bool foundLine = false;
-    std::string line;
-    while (std::getline(fin, line)) {
-        std::stringstream ss(line);
-        std::string cName, cCode, sName, sCode;
-        std::getline(ss, cName, ',');
-        std::getline(ss, cCode, ',');
-        std::getline(ss, sName, ',');
-        std::getline(ss, sCode, ',');
-        if (cCode == code) {
+    for (int r = 0; r < numRuns; r++) {
+        CsvCursor cursor(data + runs[r].offset, data + runs[r].offset + runs[r].length);
+        std::string_view line;
+        while (cursor.nextLine(line)) {
+            std::string_view cName, cCode, sName, sCode;
+            CsvCursor::nextField(line, cName);
+            CsvCursor::nextField(line, cCode);
+            if (cCode != code)
+                continue;
+            CsvCursor::nextField(line, sName);
+            CsvCursor::nextField(line, sCode);
             // If this is the first matching line, create the country node.
-            if (!foundLine) {
-                newC = new CountryNode(cName, cCode);
-                foundLine = true;
-            }
-            // Create a new series for this line.
-            Series *newSeries = new Series(sName, sCode);
-            int year = 1960;
-            std::string val;
-            while (std::getline(ss, val, ',')) {
-                double numValue = (val.empty() || val == "-1") ? -1 : std::stod(val);
-                if (newSeries->numEntries >= newSeries->maxEntries)
-                    newSeries->resize();
-                newSeries->years[newSeries->numEntries] = year;
-                newSeries->values[newSeries->numEntries] = numValue;
-                newSeries->numEntries++;
-                year++;
-            }
-            // Append newSeries to the country's timeSeries linked list.
-            if (newC->timeSeries == nullptr) {
-                newC->timeSeries = newSeries;
-            } else {
-                Series *cursor = newC->timeSeries;
-                while (cursor->next != nullptr)
-                    cursor = cursor->next;
-                cursor->next = newSeries;
-            }
+            if (newC == nullptr)
+                newC = newCountry(cName, cCode);
+            appendRow(newC, sName, sCode, line);
         }
     }
-
-    fin.close();
+    repackColumns();
     if (!newC)
         return false;
     bool ok = hashInsert(newC);
     if (!ok) {
-        delete newC;
+        releaseSeries(newC);
+        freeCountry(newC);
         return false;
     }
-    // Now, update the build structure if a BUILD was previously done.
-    if (!lastBuiltSeries.empty()) {
-        // Check if the new country has the lastBuiltSeries data.
-        Series *s = newC->timeSeries;
-        bool found = false;
-        double sum = 0.0;
-        int validCount = 0;
-        while (s != nullptr) {
-            if (s->seriesCode == lastBuiltSeries) {
-                found = true;
-                for (int j = 0; j < s->numEntries; j++) {
-                    if (s->values[j] != -1) {
-                        sum += s->values[j];
-                        validCount++;
-                    }
-                }
-                break;
-            }
-            s = s->next;
-        }
-        if (found) {
-            double mean = (validCount > 0) ? (sum / validCount) : 0.0;
-            // If buildEntries is not allocated, allocate it.
-            if (buildEntries == nullptr) {
-                buildCapacity = 1;
-                buildEntries = new Entry*[buildCapacity];
-                buildSize = 0;
-            } else if (buildSize >= buildCapacity) {
-                // Reallocate: double the capacity.
-                int newCapacity = (buildCapacity == 0 ? 1 : buildCapacity * 2);
-                Entry **newEntries = new Entry*[newCapacity];
-                for (int i = 0; i < buildSize; i++) {
-                    newEntries[i] = buildEntries[i];
-                }
-                delete[] buildEntries;
-                buildEntries = newEntries;
-                buildCapacity = newCapacity;
-            }
-            Entry *e = new Entry();
-            e->countryName = newC->countryName;
-            e->mean = mean;
-            buildEntries[buildSize++] = e;
-        }
-    }
+    // Now, update the active and cached builds.
+    addToBuilds(newC);
     return true;
 }
 
+// With a current sidecar index (see INDEX) only the code's own rows are read; without
+// one the whole file is scanned.
+bool CountryData::insertCommand(const std::string &code, const std::string &filename) {
+    STATS_TIME(STAT_INSERT);
+    std::pair<int,int> sr = hashSearch(code);
+    if (sr.first != -1)
+        return false; // Already in table.
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    RowIndex index;
+    return insertFromFile(code, file, index.load(filename) ? &index : nullptr);
+}
+
+bool CountryData::insertCommand(const std::string &code, const MappedFile &file, const RowIndex *index) {
+    STATS_TIME(STAT_INSERT);
+    return insertFromFile(code, file, index);
+}
+
+bool CountryData::insertFromFile(const std::string &code, const MappedFile &file, const RowIndex *index) {
+    if (hashSearch(code).first != -1)
+        return false;
+    RowRun whole = { 0, file.size() };
+    const RowRun *runs = &whole;
+    int numRuns = 1;
+    if (index != nullptr) {
+        int i = index->find(code);
+        if (i == -1)
+            return false;
+        runs = index->runsOf(i, numRuns);
+    }
+    return insertRuns(code, file.data(), runs, numRuns);
+}
+
+// The file is indexed once (or its sidecar read), then each missing code's rows are read
+// straight from their runs.
+int CountryData::insertBatchCommand(const std::vector<std::string> &codes, const std::string &filename) {
+    STATS_TIME(STAT_INSERT);
+    MappedFile file;
+    if (!file.open(filename))
+        return 0;
+    RowIndex index;
+    if (!index.load(filename))
+        index.build(file.data(), file.size());
+    return insertBatchFromFile(codes, file, index);
+}
+
+int CountryData::insertBatchCommand(const std::vector<std::string> &codes, const MappedFile &file,
+                                    const RowIndex &index) {
+    STATS_TIME(STAT_INSERT);
+    return insertBatchFromFile(codes, file, index);
+}
+
+int CountryData::insertBatchFromFile(const std::vector<std::string> &codes, const MappedFile &file,
+                                     const RowIndex &index) {
+    int inserted = 0;
+    int count = codes.empty() ? index.numCodes() : (int)codes.size();
+    for (int k = 0; k < count; k++) {
+        const std::string &code = codes.empty() ? index.code(k) : codes[k];
+        int i = index.find(code);
+        if (i == -1 || hashSearch(code).first != -1)
+            continue;
+        int numRuns;
+        const RowRun *runs = index.runsOf(i, numRuns);
+        if (insertRuns(code, file.data(), runs, numRuns))
+            inserted++;
+    }
+    return inserted;
+}
+
+// INDEX: write the sidecar "<file>.idx" that INSERT seeks with.
+bool CountryData::indexCommand(const std::string &filename) const {
+    STATS_TIME(STAT_INDEX);
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    RowIndex index;
+    index.build(file.data(), file.size());
+    return index.save(filename);
+}
+
 std::pair<int,int> CountryData::lookupCommand(const std::string &code) const {
+    STATS_TIME(STAT_LOOKUP);
     return hashSearch(code);
 }
 
 bool CountryData::removeCommand(const std::string &code) {
+    STATS_TIME(STAT_REMOVE);
+    std::pair<int,int> sr = hashSearch(code);
+    if (sr.first == -1)
+        return false;
+    removeFromBuilds(countryArray[sr.first]);
     return hashRemove(code);
 }
 
-// LOAD Command (Using Hashing)
-bool CountryData::loadFromFile(const std::string &filename) {
-    std::ifstream fin(filename);
-    if (!fin.is_open()) {
-        return false;
+// COLUMN STORE HELPERS
+// Look up the column for a series code, or nullptr if no country has that series.
+CountryData::Column *CountryData::findColumn(std::string_view code) const {
+    if (columnIndexSize == 0)
+        return nullptr;
+    unsigned int mask = (unsigned int)columnIndexSize - 1;
+    unsigned int pos = (unsigned int)std::hash<std::string_view>()(code) & mask;
+    while (columnIndex[pos] != nullptr) {
+        if (columnIndex[pos]->seriesCode == code)
+            return columnIndex[pos];
+        pos = (pos + 1) & mask;
+    }
+    return nullptr;
+}
+
+// Look up the column for a series code, creating it on first use.
+CountryData::Column *CountryData::getColumn(std::string_view code) {
+    Column *col = findColumn(code);
+    if (col != nullptr)
+        return col;
+
+    if (columnCount >= columnCapacity) {
+        int newCapacity = (columnCapacity == 0) ? 64 : columnCapacity * 2;
+        Column **newColumns = new Column*[newCapacity];
+        for (int i = 0; i < columnCount; i++)
+            newColumns[i] = columns[i];
+        delete[] columns;
+        columns = newColumns;
+        columnCapacity = newCapacity;
     }
-    // Clear existing data
-    for (int i = 0; i < MAX_COUNTRIES; i++) {
-        if (countryArray[i] != nullptr) {
-            delete countryArray[i];
-            countryArray[i] = nullptr;
+    col = new Column(std::string(code), columnCount);
+    col->codeId = strings.intern(code);
+    columns[columnCount++] = col;
+    // A build of this code made while it had no column can now be matched by id.
+    for (int i = -1; i < buildCacheCount; i++) {
+        BuildTable &t = (i < 0) ? build : buildCache[i];
+        if (t.codeId == StringPool::NO_STRING && t.seriesCode == code)
+            t.codeId = col->codeId;
+    }
+
+    // Keep the code index at most half full; it is linear-probed and never has deletions.
+    if (columnCount * 2 > columnIndexSize) {
+        delete[] columnIndex;
+        columnIndexSize = (columnIndexSize == 0) ? 128 : columnIndexSize * 2;
+        columnIndex = new Column*[columnIndexSize];
+        for (int i = 0; i < columnIndexSize; i++)
+            columnIndex[i] = nullptr;
+        for (int i = 0; i < columnCount; i++)
+            indexColumn(columns[i]);
+    } else {
+        indexColumn(col);
+    }
+    return col;
+}
+
+void CountryData::indexColumn(Column *col) {
+    unsigned int mask = (unsigned int)columnIndexSize - 1;
+    unsigned int pos = (unsigned int)std::hash<std::string>()(col->seriesCode) & mask;
+    while (columnIndex[pos] != nullptr)
+        pos = (pos + 1) & mask;
+    columnIndex[pos] = col;
+}
+
+// Drop every column (LOAD and the destructor; the countries must already be gone).
+void CountryData::clearColumns() {
+    for (int i = 0; i < columnCount; i++)
+        delete columns[i];
+    delete[] columns;
+    delete[] columnIndex;
+    columns = nullptr;
+    columnIndex = nullptr;
+    columnCount = 0;
+    columnCapacity = 0;
+    columnIndexSize = 0;
+}
+
+// Give country c a new series in column col and register it in the column's ref index.
+CountryData::Series &CountryData::attachSeries(CountryNode *c, Column *col, std::string_view sName) {
+    Series &s = c->addSeries(arena);
+    s.nameId = strings.intern(sName);
+    s.column = col;
+    s.offset = col->size;
+    s.numEntries = 0;
+    s.count = 0;
+    s.sum = 0.0;
+    s.refIndex = col->addRef(c, c->numSeries - 1);
+    return s;
+}
+
+// A country is leaving the table: unlink its series from the column ref index, and
+// their slices become dead space. Columns that end up mostly dead are compacted.
+void CountryData::releaseSeries(CountryNode *c) {
+    for (int i = 0; i < c->numSeries; i++) {
+        Column *col = c->series[i].column;
+        col->removeRef(c->series[i].refIndex);
+        col->deadValues += c->series[i].numEntries;
+        if (col->deadValues * 2 > col->size && col->size >= COMPACT_MIN_VALUES)
+            compactColumn(col);
+    }
+    c->numSeries = 0;
+}
+
+// Rewrite a mostly-dead column so it only holds live slices, found through its refs.
+// A packed column (or one a write has just decoded) is packed again afterwards.
+void CountryData::compactColumn(Column *col) {
+    parseColumn(col);
+    bool wasPacked = (col->values == nullptr || !col->packed.empty());
+    Column live(col->seriesCode, col->id);
+    live.reserve(col->size - col->deadValues);
+    Column::BlockCursor values(col);
+    for (int i = 0; i < col->numRefs; i++) {
+        Series &s = col->refs[i].country->series[col->refs[i].seriesIndex];
+        int newOffset = live.size;
+        for (int j = s.offset; j < s.offset + s.numEntries; j++)
+            live.append(values.at(j), col->isValid(j));
+        s.offset = newOffset;
+    }
+    std::swap(col->values, live.values);
+    std::swap(col->validity, live.validity);
+    std::swap(col->mapped, live.mapped);
+    col->packed.clear();
+    col->size = live.size;
+    col->capacity = live.capacity;
+    col->deadValues = 0;
+    // Every offset moved; the window index is rebuilt on its next use.
+    col->windows.clear();
+    col->windowsCurrent = false;
+    if (wasPacked)
+        col->pack();
+}
+
+// Set a series' running totals from the values in its slice.
+void CountryData::sumSeries(Series &s) const {
+    const Column *col = s.column;
+    SeriesKernels::SumCount sc = SeriesKernels::maskedSum(col->values, col->validity, s.offset, s.numEntries);
+    s.sum = sc.sum;
+    s.count = sc.count;
+}
+
+// Mean of one series slice over its valid values, 0 if there are none.
+double CountryData::sliceMean(const Series &s) const {
+    return (s.count > 0) ? (s.sum / s.count) : 0.0;
+}
+
+// Copy a series slice to the end of its column, with room for 'extra' more values after
+// it, so it can grow. The old slice becomes dead space.
+void CountryData::moveToTail(Column *col, Series &s, int extra) {
+    col->reserve(s.numEntries + extra);
+    int newOffset = col->size;
+    for (int j = s.offset; j < s.offset + s.numEntries; j++)
+        col->append(col->values[j], col->isValid(j));
+    col->deadValues += s.numEntries;
+    s.offset = newOffset;
+}
+
+// Index every live slice of a column for window aggregates, unless that is already done.
+// A column is indexed on the first windowed BUILD of its code and kept current after that.
+void CountryData::ensureWindows(Column *col) {
+    if (col->windowsCurrent)
+        return;
+    col->windows.clear();
+    col->windows.reserve(col->capacity);
+    if (col->values != nullptr) {
+        for (int i = 0; i < col->numRefs; i++) {
+            const Series &s = col->refs[i].country->series[col->refs[i].seriesIndex];
+            col->windows.indexSlice(col->values, col->validity, s.offset, s.numEntries);
         }
-        slotStatus[i] = STATUS_EMPTY;
+        col->windowsCurrent = true;
+        return;
     }
-    countryCount = 0;
-    deleteBuildEntries();
+    // Packed: visit the slices in column order, so each block is decoded once.
+    std::vector<std::pair<int,int>> slices(col->numRefs);
+    for (int i = 0; i < col->numRefs; i++) {
+        const Series &s = col->refs[i].country->series[col->refs[i].seriesIndex];
+        slices[i] = std::make_pair(s.offset, s.numEntries);
+    }
+    std::sort(slices.begin(), slices.end());
+    Column::BlockCursor values(col);
+    for (size_t i = 0; i < slices.size(); i++) {
+        int offset = slices[i].first, n = slices[i].second;
+        col->windows.beginSlice(n);
+        for (int pos = offset; pos < offset + n; pos++)
+            col->windows.addValue(pos, values.at(pos), col->isValid(pos));
+        col->windows.finishSlice(offset, n);
+    }
+    col->windowsCurrent = true;
+}
 
-    std::string line;
-    while (std::getline(fin, line)) {
-        if (countryCount >= MAX_COUNTRIES)
-            break;
-        std::stringstream ss(line);
-        std::string cName, cCode, sName, sCode;
-        std::getline(ss, cName, ',');
-        std::getline(ss, cCode, ',');
-        std::getline(ss, sName, ',');
-        std::getline(ss, sCode, ',');
-
-        std::pair<int,int> sr = hashSearch(cCode);
-        CountryNode *cn = nullptr;
-        if (sr.first == -1) {
-            cn = new CountryNode(cName, cCode);
-            if (!hashInsert(cn)) {
-                delete cn;
-                break;
+// A slice was written: refresh its part of the window index, if the column has one.
+void CountryData::reindexSlice(Column *col, const Series &s) {
+    if (!col->windowsCurrent)
+        return;
+    col->windows.reserve(col->capacity);
+    col->windows.indexSlice(col->values, col->validity, s.offset, s.numEntries);
+}
+
+// The value build t gives series s: its aggregate over t's years, or 0 if none of them
+// has a valid value. The all-years mean comes straight from the running totals.
+double CountryData::aggregate(Column *col, const Series &s, const BuildTable &t) {
+    parseColumn(col);
+    bool allYears = (t.fromYear == 0 && t.toYear == 0);
+    if (allYears && t.kind == AGG_MEAN)
+        return sliceMean(s);
+    int first = 0, last = s.numEntries - 1;
+    if (!allYears) {
+        first = std::max(first, t.fromYear - BASE_YEAR);
+        last = std::min(last, t.toYear - BASE_YEAR);
+    }
+    if (first > last)
+        return 0.0;
+    ensureWindows(col);
+    WindowStats w = col->windows.query(s.offset, first, last);
+    if (w.count == 0)
+        return 0.0;
+    double mean = w.sum / w.count;
+    switch (t.kind) {
+    case AGG_MIN:
+        return w.min;
+    case AGG_MAX:
+        return w.max;
+    case AGG_COUNT:
+        return w.count;
+    case AGG_STDDEV:
+        // Population standard deviation; rounding can push a flat window just below zero.
+        return std::sqrt(std::max(0.0, w.squares / w.count - mean * mean));
+    default:
+        return mean;
+    }
+}
+
+// Build t's value for the country's first series in column col.
+// Returns false if the country has no series in that column.
+bool CountryData::seriesValue(const CountryNode *c, Column *col, const BuildTable &t, double &value) {
+    for (int i = 0; i < c->numSeries; i++) {
+        if (c->series[i].column == col) {
+            value = aggregate(col, c->series[i], t);
+            return true;
+        }
+    }
+    return false;
+}
+
+// CSV parsing helpers shared by LOAD, INSERT and APPEND
+// Parse one row's value fields (everything after the series code) straight into the
+// series code's column. Fields are read in place from the mapped file.
+void CountryData::appendRow(CountryNode *c, std::string_view sName, std::string_view sCode,
+                            std::string_view fields) {
+    Column *col = getColumn(sCode);
+    parseColumn(col);
+    Series &s = attachSeries(c, col, sName);
+    // Count the fields first so the column is sized up once for the whole row.
+    int numFields = 0;
+    std::string_view rest = fields, val;
+    while (CsvCursor::nextField(rest, val))
+        numFields++;
+    if (numFields > 0)
+        col->reserve(numFields);
+    while (CsvCursor::nextField(fields, val)) {
+        double value;
+        bool valid = CsvCursor::parseValue(val, value);
+        col->append(value, valid);
+        s.numEntries++;
+    }
+    sumSeries(s);
+    reindexSlice(col, s);
+}
+
+// Merge one APPEND row into country c. If c has no series with this code yet, the row
+// becomes a new one. Otherwise it is merged into c's first series with the code: each
+// value present in the row replaces the stored value for that year, and years past the
+// end of the series extend it (after moving the slice to the end of its column, unless it
+// is already there). The running totals are adjusted per changed value, the slice is
+// reindexed, and the country's entry in every build of the code moves to its new value.
+void CountryData::mergeRow(CountryNode *c, std::string_view sName, std::string_view sCode,
+                           std::string_view fields) {
+    Column *col = getColumn(sCode);
+    parseColumn(col);
+    Series *s = nullptr;
+    for (int i = 0; i < c->numSeries && s == nullptr; i++) {
+        if (c->series[i].column == col)
+            s = &c->series[i];
+    }
+    if (s == nullptr) {
+        appendRow(c, sName, sCode, fields);
+        addSeriesToBuilds(c, col);
+        return;
+    }
+    Entry *taken[BUILD_CACHE_SIZE + 1];
+    takeFromBuilds(c, col, taken);
+
+    int numFields = 0;
+    std::string_view rest = fields, val;
+    while (CsvCursor::nextField(rest, val))
+        numFields++;
+    int extra = (numFields > s->numEntries) ? numFields - s->numEntries : 0;
+    if (extra > 0 && s->offset + s->numEntries != col->size)
+        moveToTail(col, *s, extra);
+    col->reserve(extra);  // also copies a mapped column out, or decodes a packed one
+
+    int i = 0;
+    while (CsvCursor::nextField(fields, val)) {
+        double value;
+        bool valid = CsvCursor::parseValue(val, value);
+        if (i >= s->numEntries) {
+            col->append(value, valid);
+            s->numEntries++;
+            if (valid) {
+                s->sum += value;
+                s->count++;
             }
-        } else {
-            cn = countryArray[sr.first];
-        }
-
-        Series *newS = new Series(sName, sCode);
-        int year = 1960;
-        std::string val;
-        while (std::getline(ss, val, ',')) {
-            double numValue = (val.empty() || val == "-1") ? -1 : std::stod(val);
-            if (newS->numEntries >= newS->maxEntries)
-                newS->resize();
-            newS->years[newS->numEntries] = year;
-            newS->values[newS->numEntries] = numValue;
-            newS->numEntries++;
-            year++;
-        }
-        if (cn->timeSeries == nullptr)
-            cn->timeSeries = newS;
-        else {
-            Series *cursor = cn->timeSeries;
-            while (cursor->next != nullptr)
-                cursor = cursor->next;
-            cursor->next = newS;
-        }
-    }
-    fin.close();
+        } else if (valid) {
+            int pos = s->offset + i;
+            if (!col->isValid(pos)) {
+                s->sum += value;
+                s->count++;
+            } else if (col->values[pos] != value) {
+                s->sum += value - col->values[pos];
+            }
+            col->set(pos, value);
+        }
+        i++;
+    }
+    reindexSlice(col, *s);
+    putBackInBuilds(c, col, taken);
+    if (col->deadValues * 2 > col->size && col->size >= COMPACT_MIN_VALUES)
+        compactColumn(col);
+}
+
+// Find the country for a row, creating and hashing it on first sight.
+// Returns nullptr if the country could not be hashed.
+CountryData::CountryNode *CountryData::findOrInsertCountry(std::string_view cName, std::string_view cCode) {
+    std::pair<int,int> sr = hashSearch(cCode);
+    if (sr.first != -1)
+        return countryArray[sr.first];
+    CountryNode *cn = newCountry(cName, cCode);
+    if (!hashInsert(cn)) {
+        freeCountry(cn);
+        return nullptr;
+    }
+    return cn;
+}
+
+// Parse every row in [begin, end) into 'chunk'. Runs on a worker thread during a parallel
+// LOAD, so it only reads the mapped file; it never touches the table or the columns.
+void CountryData::parseChunk(const char *begin, const char *end, ParsedChunk &chunk) const {
+    CsvCursor cursor(begin, end);
+    std::string_view line;
+    while (cursor.nextLine(line)) {
+        ParsedRow row;
+        CsvCursor::nextField(line, row.countryName);
+        CsvCursor::nextField(line, row.countryCode);
+        CsvCursor::nextField(line, row.seriesName);
+        CsvCursor::nextField(line, row.seriesCode);
+        row.valueOffset = chunk.values.size();
+        std::string_view val;
+        while (CsvCursor::nextField(line, val)) {
+            double value;
+            chunk.valid.push_back(CsvCursor::parseValue(val, value));
+            chunk.values.push_back(value);
+        }
+        row.numValues = (int)(chunk.values.size() - row.valueOffset);
+        chunk.rows.push_back(row);
+    }
+}
+
+void CountryData::setLoadThreads(int threads) {
+    loadThreads = (threads > 0) ? threads : 1;
+}
+
+void CountryData::setBuildThreads(int threads) {
+    buildThreads = (threads > 0) ? threads : 1;
+}
+
+void CountryData::setLazyLoad(bool lazy) {
+    lazyLoad = lazy;
+}
+
+// Clear existing data and shrink back to the initial table
+void CountryData::clearForLoad() {
+    clearTable();
+    clearColumns();
+    closeSnapshot();
+    closeLoadFile();
+    if (tableSize != FIRST_TABLE_SIZE) {
+        freeTable();
+        allocateTable(FIRST_TABLE_SIZE);
+    }
+    if (nameIndexSize != INITIAL_TABLE_SIZE) {
+        delete[] nameIndex;
+        delete[] nameStatus;
+        allocateNameIndex(INITIAL_TABLE_SIZE);
+    }
+    clearBuilds();
+}
+
+// LOAD Command (Using Hashing)
+bool CountryData::loadFromFile(const MappedFile &file) {
+    clearForLoad();
+
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+
+    // Small files are not worth the thread start-up cost.
+    size_t chunks = (size_t)loadThreads;
+    if (chunks > file.size() / MIN_LOAD_CHUNK_BYTES)
+        chunks = file.size() / MIN_LOAD_CHUNK_BYTES;
+
+    if (chunks <= 1) {
+        CsvCursor cursor(begin, end);
+        std::string_view line;
+        while (cursor.nextLine(line)) {
+            std::string_view cName, cCode, sName, sCode;
+            CsvCursor::nextField(line, cName);
+            CsvCursor::nextField(line, cCode);
+            CsvCursor::nextField(line, sName);
+            CsvCursor::nextField(line, sCode);
+            CountryNode *cn = findOrInsertCountry(cName, cCode);
+            if (cn == nullptr)
+                continue;
+            appendRow(cn, sName, sCode, line);
+        }
+        packColumns();
+        return true;
+    }
+
+    // Parallel LOAD: split the file at line boundaries, parse each chunk on its own
+    // thread, then merge the rows into the hash table in file order so every country's
+    // series list comes out exactly as a serial LOAD would build it.
+    std::vector<const char *> bounds(chunks + 1);
+    bounds[0] = begin;
+    bounds[chunks] = end;
+    for (size_t t = 1; t < chunks; t++) {
+        const char *p = begin + file.size() * t / chunks;
+        if (p < bounds[t - 1])
+            p = bounds[t - 1];
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        bounds[t] = (nl != nullptr) ? nl + 1 : end;
+    }
+
+    std::vector<ParsedChunk> parsed(chunks);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < chunks; t++)
+        workers.emplace_back(&CountryData::parseChunk, this, bounds[t], bounds[t + 1], std::ref(parsed[t]));
+    parseChunk(bounds[0], bounds[1], parsed[0]);
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    for (size_t t = 0; t < chunks; t++) {
+        const ParsedChunk &chunk = parsed[t];
+        for (size_t r = 0; r < chunk.rows.size(); r++) {
+            const ParsedRow &row = chunk.rows[r];
+            CountryNode *cn = findOrInsertCountry(row.countryName, row.countryCode);
+            if (cn == nullptr)
+                continue;
+            Column *col = getColumn(row.seriesCode);
+            col->reserve(row.numValues);
+            Series &s = attachSeries(cn, col, row.seriesName);
+            s.numEntries = row.numValues;
+            for (int j = 0; j < row.numValues; j++)
+                col->append(chunk.values[row.valueOffset + j], chunk.valid[row.valueOffset + j]);
+            sumSeries(s);
+        }
+    }
+    packColumns();
+    return true;
+}
+
+// Lazy LOAD: countries and series are created as LOAD would, but each row's values are
+// only counted, so every slice gets its final place; the text stays in the mapped file.
+bool CountryData::deferFromFile(const std::shared_ptr<MappedFile> &file) {
+    clearForLoad();
+    loadFile = file;
+    CsvCursor cursor(file->data(), file->data() + file->size());
+    std::string_view line;
+    while (cursor.nextLine(line)) {
+        std::string_view cName, cCode, sName, sCode;
+        CsvCursor::nextField(line, cName);
+        CsvCursor::nextField(line, cCode);
+        CsvCursor::nextField(line, sName);
+        CsvCursor::nextField(line, sCode);
+        CountryNode *cn = findOrInsertCountry(cName, cCode);
+        if (cn == nullptr)
+            continue;
+        deferRow(cn, sName, sCode, line);
+    }
     return true;
 }
 
+void CountryData::deferRow(CountryNode *c, std::string_view sName, std::string_view sCode,
+                           std::string_view fields) {
+    Column *col = getColumn(sCode);
+    Series &s = attachSeries(c, col, sName);
+    std::string_view rest = fields, val;
+    while (CsvCursor::nextField(rest, val))
+        s.numEntries++;
+    if (s.numEntries > 0)
+        col->addTextRow(fields, s.offset);
+    col->size += s.numEntries;
+}
+
+// Give a lazily loaded column its values: parse its text rows into a buffer sized as LOAD
+// would have grown it, set its series' totals, and pack it like any loaded column.
+void CountryData::parseColumn(Column *col) {
+    if (col->textRows == nullptr)
+        return;
+    int capacity = 64;
+    while (capacity < col->size)
+        capacity *= 2;
+    col->values = new double[capacity];
+    col->validity = new uint64_t[capacity / 64];
+    memset(col->validity, 0, (capacity / 64) * sizeof(uint64_t));
+    col->capacity = capacity;
+    col->parseText(col->values, col->validity);
+    delete[] col->textRows;
+    col->textRows = nullptr;
+    col->numTextRows = 0;
+    col->maxTextRows = 0;
+    for (int i = 0; i < col->numRefs; i++)
+        sumSeries(col->refs[i].country->series[col->refs[i].seriesIndex]);
+    col->pack();
+}
+
+// A series' running totals, worked out from its text if its column is still unparsed.
+// The row is parsed at its offset modulo 64, so maskedSum adds in the same order as it
+// will once the column is parsed.
+void CountryData::seriesTotals(const Series &s, int &count, double &sum) const {
+    const Column::TextRow *row = (s.numEntries > 0) ? s.column->findTextRow(s.offset) : nullptr;
+    if (row == nullptr) {
+        count = s.count;
+        sum = s.sum;
+        return;
+    }
+    int at = s.offset & 63;
+    std::vector<double> values(at + s.numEntries);
+    std::vector<uint64_t> validity((at + s.numEntries + 63) / 64, 0);
+    parseFields(std::string_view(row->fields, row->length), values.data(), validity.data(), at);
+    SeriesKernels::SumCount sc = SeriesKernels::maskedSum(values.data(), validity.data(), at, s.numEntries);
+    count = sc.count;
+    sum = sc.sum;
+}
+
+// Compress every column LOAD filled. Columns are independent, so the load threads
+// share them out.
+void CountryData::packColumns() {
+    int threads = std::min(loadThreads, columnCount);
+    if (threads <= 1) {
+        for (int i = 0; i < columnCount; i++)
+            columns[i]->pack();
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([this, t, threads]() {
+            for (int i = t; i < columnCount; i += threads)
+                columns[i]->pack();
+        });
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+// Pack again every column a write has decoded (see Column::reserve). INSERT and APPEND
+// call this when they are done, so a column is only a plain buffer while it is written.
+void CountryData::repackColumns() {
+    for (int i = 0; i < columnCount; i++) {
+        if (columns[i]->values != nullptr && !columns[i]->packed.empty())
+            columns[i]->pack();
+    }
+}
+
+// APPEND: merge a delta file into the table instead of reloading it. Rows for unknown
+// countries create them, as LOAD does; rows for known ones go through mergeRow. The
+// builds are corrected entry by entry, so the work follows the size of the delta.
+bool CountryData::appendCommand(const std::string &filename) {
+    STATS_TIME(STAT_APPEND);
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    appendFromFile(file);
+    return true;
+}
+
+bool CountryData::appendCommand(const MappedFile &file) {
+    STATS_TIME(STAT_APPEND);
+    appendFromFile(file);
+    return true;
+}
+
+void CountryData::appendFromFile(const MappedFile &file) {
+    CsvCursor cursor(file.data(), file.data() + file.size());
+    std::string_view line;
+    while (cursor.nextLine(line)) {
+        std::string_view cName, cCode, sName, sCode;
+        CsvCursor::nextField(line, cName);
+        CsvCursor::nextField(line, cCode);
+        CsvCursor::nextField(line, sName);
+        CsvCursor::nextField(line, sCode);
+        CountryNode *cn = findOrInsertCountry(cName, cCode);
+        if (cn == nullptr)
+            continue;
+        mergeRow(cn, sName, sCode, line);
+    }
+    repackColumns();
+}
+
+// A lazy LOAD keeps the file open (and reads it at random), so it gets its own mapping;
+// an eager one reads it front to back once.
 bool CountryData::load(const std::string &filename) {
-    return loadFromFile(filename);
+    STATS_TIME(STAT_LOAD);
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename, !lazyLoad))
+        return false;
+    return lazyLoad ? deferFromFile(file) : loadFromFile(*file);
+}
+
+bool CountryData::load(const std::shared_ptr<MappedFile> &file) {
+    STATS_TIME(STAT_LOAD);
+    return lazyLoad ? deferFromFile(file) : loadFromFile(*file);
+}
+
+// SNAPSHOT (SAVE / OPEN)
+// Payload order: probing scheme, table size and slot statuses, columns (values and validity as raw
+// arrays), countries in slot order with their series slices and running totals, then the active
+// build.
+bool CountryData::saveCommand(const std::string &filename) const {
+    STATS_TIME(STAT_SAVE);
+    SnapshotWriter out;
+    // Every slot's status, tombstones included, so OPEN reproduces the probe sequences
+    // and LOOKUP reports the same index and search count. The layout is only meaningful
+    // to a build with the same probing scheme.
+    out.putString(TABLE_SCHEME);
+    out.putInt(tableSize);
+    out.putArray(slotStatus, tableSize * sizeof(int));
+
+    out.putInt(columnCount);
+    std::vector<double> scratch;
+    std::vector<uint64_t> scratchValidity;
+    double block[64];
+    for (int i = 0; i < columnCount; i++) {
+        const Column *col = columns[i];
+        int words = (col->size + 63) / 64;
+        out.putString(col->seriesCode);
+        out.putInt(col->size);
+        out.putInt(col->deadValues);
+        if (col->textRows != nullptr) {
+            // Still unparsed (lazy LOAD): parse a copy; a SAVE must not change the table.
+            scratch.assign(col->size, 0.0);
+            scratchValidity.assign(words, 0);
+            col->parseText(scratch.data(), scratchValidity.data());
+            out.putArray(scratch.data(), col->size * sizeof(double));
+            out.putArray(scratchValidity.data(), words * sizeof(uint64_t));
+            continue;
+        }
+        if (col->values != nullptr) {
+            out.putArray(col->values, col->size * sizeof(double));
+        } else {
+            // Packed: one block at a time. The pieces are whole doubles, so no padding
+            // goes between them and the payload is the same as for a plain buffer.
+            for (int b = 0; b < words; b++) {
+                col->packed.decodeBlock(b, col->validity, block);
+                out.putArray(block, std::min(64, col->size - b * 64) * sizeof(double));
+            }
+        }
+        out.putArray(col->validity, words * sizeof(uint64_t));
+    }
+
+    out.putInt(countryCount);
+    for (int i = 0; i < tableSize; i++) {
+        if (slotStatus[i] != STATUS_OCCUPIED)
+            continue;
+        const CountryNode *c = countryArray[i];
+        out.putInt(i);
+        out.putString(c->countryName);
+        out.putString(c->countryCode);
+        out.putInt(c->numSeries);
+        for (int j = 0; j < c->numSeries; j++) {
+            const Series &s = c->series[j];
+            out.putString(strings.get(s.nameId));
+            out.putInt(s.column->id);
+            out.putInt(s.offset);
+            out.putInt(s.numEntries);
+            int count;
+            double sum;
+            seriesTotals(s, count, sum);
+            out.putInt(count);
+            out.putDouble(sum);
+        }
+    }
+
+    out.putString(build.seriesCode);
+    out.putInt(build.fromYear);
+    out.putInt(build.toYear);
+    out.putInt(build.kind);
+    out.putInt(build.complete ? 1 : 0);
+    out.putInt(build.size);
+    for (int i = 0; i < build.size; i++) {
+        out.putString(build.entries[i]->countryName);
+        out.putDouble(build.entries[i]->mean);
+    }
+    return out.writeTo(filename);
+}
+
+// Replace everything with the contents of a snapshot. Column values are not copied:
+// they are served from the mapping until an INSERT appends to their column. The whole
+// snapshot is checked before the current data is dropped, so a failed OPEN keeps it.
+bool CountryData::openCommand(const std::string &filename) {
+    STATS_TIME(STAT_OPEN);
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename, false))
+        return false;
+    return openFromFile(file);
+}
+
+bool CountryData::openCommand(const std::shared_ptr<MappedFile> &file) {
+    STATS_TIME(STAT_OPEN);
+    return openFromFile(file);
+}
+
+bool CountryData::openFromFile(const std::shared_ptr<MappedFile> &file) {
+    SnapshotReader in(file->data(), file->size());
+    if (!in.ok() || !checkSnapshot(in))
+        return false;  // not a snapshot, wrong version, corrupt or another scheme's; keep the current data
+
+    clearTable();
+    clearColumns();
+    closeSnapshot();
+    closeLoadFile();
+    clearBuilds();
+    snapshotFile = file;
+    restoreSnapshot(in);
+    return true;
+}
+
+// Walk a snapshot's whole payload on a copy of the reader and check everything
+// restoreSnapshot relies on, without touching the table: the probing scheme (the slot
+// layout is only meaningful to a build with the same one), the table size, every count
+// and every slot, column and slice bound.
+bool CountryData::checkSnapshot(SnapshotReader in) const {
+    if (in.getString() != TABLE_SCHEME)
+        return false;
+    int64_t size = in.getInt();
+#ifdef COUNTRYDATA_DIRECT_TABLE
+    if (!in.ok() || size != FIRST_TABLE_SIZE)
+        return false;
+#else
+    if (!in.ok() || size < INITIAL_TABLE_SIZE || size > (1 << 30) || (size & (size - 1)) != 0)
+        return false;
+#endif
+    const int *status = static_cast<const int *>(in.getArray(size * sizeof(int)));
+    if (status == nullptr)
+        return false;
+    int64_t occupied = 0;
+    for (int64_t i = 0; i < size; i++) {
+        if (status[i] == STATUS_OCCUPIED)
+            occupied++;
+    }
+
+    int64_t numColumns = in.getInt();
+    if (!in.ok() || numColumns < 0)
+        return false;
+    std::vector<std::string_view> codes;
+    std::vector<int64_t> columnSizes;
+    for (int64_t i = 0; i < numColumns; i++) {
+        std::string_view code = in.getString();
+        int64_t numValues = in.getInt();
+        int64_t deadValues = in.getInt();
+        if (!in.ok() || numValues < 0 || numValues > (1 << 30) || deadValues < 0 || deadValues > numValues)
+            return false;
+        int64_t words = (numValues + 63) / 64;
+        in.getArray(numValues * sizeof(double));
+        in.getArray(words * sizeof(uint64_t));
+        if (!in.ok())
+            return false;
+        codes.push_back(code);
+        columnSizes.push_back(numValues);
+    }
+    std::sort(codes.begin(), codes.end());
+    if (std::adjacent_find(codes.begin(), codes.end()) != codes.end())
+        return false;  // duplicate series code
+
+    int64_t numCountries = in.getInt();
+    if (!in.ok() || numCountries != occupied)
+        return false;
+    std::vector<bool> filled(size, false);
+    for (int64_t i = 0; i < numCountries; i++) {
+        int64_t slot = in.getInt();
+        in.getString();
+        in.getString();
+        int64_t numSeries = in.getInt();
+        if (!in.ok() || slot < 0 || slot >= size || status[slot] != STATUS_OCCUPIED || filled[slot] ||
+            numSeries < 0)
+            return false;
+        filled[slot] = true;
+        for (int64_t j = 0; j < numSeries; j++) {
+            in.getString();
+            int64_t columnId = in.getInt();
+            int64_t offset = in.getInt();
+            int64_t numEntries = in.getInt();
+            int64_t count = in.getInt();
+            in.getDouble();
+            if (!in.ok() || columnId < 0 || columnId >= numColumns || offset < 0 || numEntries < 0 ||
+                offset + numEntries > columnSizes[columnId] || count < 0 || count > numEntries)
+                return false;
+        }
+    }
+
+    in.getString();
+    int64_t fromYear = in.getInt();
+    int64_t toYear = in.getInt();
+    int64_t kind = in.getInt();
+    in.getInt();
+    int64_t numEntries = in.getInt();
+    if (!in.ok() || numEntries < 0 || numEntries > numCountries || kind < AGG_MEAN || kind > AGG_STDDEV ||
+        fromYear != (int)fromYear || toYear != (int)toYear)
+        return false;
+    for (int64_t i = 0; i < numEntries && in.ok(); i++) {
+        in.getString();
+        in.getDouble();
+    }
+    return in.ok();
+}
+
+// Fill the (cleared) table from a snapshot that passed checkSnapshot.
+void CountryData::restoreSnapshot(SnapshotReader &in) {
+    in.getString();
+    int size = (int)in.getInt();
+    const int *status = static_cast<const int *>(in.getArray(size * sizeof(int)));
+    freeTable();
+    allocateTable(size);
+    if (nameIndexSize != INITIAL_TABLE_SIZE) {
+        delete[] nameIndex;
+        delete[] nameStatus;
+        allocateNameIndex(INITIAL_TABLE_SIZE);
+    }
+    for (int i = 0; i < tableSize; i++) {
+        if (status[i] == STATUS_PREV_OCCUPIED) {
+            setSlot(i, nullptr, STATUS_PREV_OCCUPIED);
+            tombstoneCount++;
+        }
+    }
+
+    int numColumns = (int)in.getInt();
+    for (int i = 0; i < numColumns; i++) {
+        std::string_view code = in.getString();
+        int numValues = (int)in.getInt();
+        int deadValues = (int)in.getInt();
+        int words = (numValues + 63) / 64;
+        const void *values = in.getArray(numValues * sizeof(double));
+        const void *validity = in.getArray(words * sizeof(uint64_t));
+        Column *col = getColumn(code);
+        if (numValues > 0) {
+            // The mapping is read-only; 'mapped' makes the column copy itself before a write.
+            col->values = static_cast<double *>(const_cast<void *>(values));
+            col->validity = static_cast<uint64_t *>(const_cast<void *>(validity));
+            col->capacity = words * 64;
+            col->mapped = true;
+        }
+        col->size = numValues;
+        col->deadValues = deadValues;
+    }
+
+    int numCountries = (int)in.getInt();
+    for (int i = 0; i < numCountries; i++) {
+        int slot = (int)in.getInt();
+        std::string_view name = in.getString();
+        std::string_view code = in.getString();
+        int numSeries = (int)in.getInt();
+        CountryNode *c = newCountry(name, code);
+        for (int j = 0; j < numSeries; j++) {
+            std::string_view sName = in.getString();
+            int columnId = (int)in.getInt();
+            Series &s = attachSeries(c, columns[columnId], sName);
+            s.offset = (int)in.getInt();
+            s.numEntries = (int)in.getInt();
+            s.count = (int)in.getInt();
+            s.sum = in.getDouble();
+        }
+        setSlot((unsigned int)slot, c, STATUS_OCCUPIED);
+        countryCount++;
+        nameIndexInsert(c);
+    }
+
+    std::string_view buildCode = in.getString();
+    setBuildCode(build, std::string(buildCode));
+    build.fromYear = (int)in.getInt();
+    build.toYear = (int)in.getInt();
+    build.kind = (AggregateKind)in.getInt();
+    build.complete = (in.getInt() != 0);
+    int numEntries = (int)in.getInt();
+    if (numEntries > 0) {
+        build.capacity = numEntries;
+        build.entries = new Entry*[build.capacity];
+        for (int i = 0; i < numEntries; i++) {
+            Entry *e = new Entry();
+            e->nameId = strings.intern(in.getString());
+            e->countryName = strings.get(e->nameId);
+            e->mean = in.getDouble();
+            build.entries[build.size++] = e;
+        }
+    }
+}
+
+// Unmap the OPENed snapshot. Its columns must already be gone (clearColumns).
+void CountryData::closeSnapshot() {
+    snapshotFile.reset();
+}
+
+// Unmap the file of a lazy LOAD, once no column has text rows in it (clearColumns).
+void CountryData::closeLoadFile() {
+    loadFile.reset();
+}
+
+// STATS
+// One line per command and per probed hash operation, then slot counts and the bytes
+// held by the country/series arrays, the columns and the builds.
+std::string CountryData::statsCommand() const {
+#ifdef COUNTRYDATA_STATS
+    std::ostringstream oss;
+    for (int i = 0; i < STAT_COMMANDS; i++)
+        oss << stats.commands[i].format(statsCommandName(i)) << "\n";
+    oss << stats.search.format("hashSearch") << "\n";
+    oss << stats.insert.format("hashInsert") << "\n";
+    oss << stats.remove.format("hashRemove") << "\n";
+
+    int occupied = 0, tombstones = 0;
+    size_t seriesBytes = 0;
+    for (int i = 0; i < tableSize; i++) {
+        if (slotStatus[i] == STATUS_OCCUPIED) {
+            occupied++;
+            seriesBytes += sizeof(CountryNode) + countryArray[i]->maxSeries * sizeof(Series);
+        } else if (slotStatus[i] == STATUS_PREV_OCCUPIED) {
+            tombstones++;
+        }
+    }
+    oss << "slots size " << tableSize << " occupied " << occupied << " tombstones " << tombstones
+        << " empty " << (tableSize - occupied - tombstones) << "\n";
+    oss << "kernels table " << TABLE_SCHEME << " sum " << SeriesKernels::kernelName() << "\n";
+
+    size_t columnBytes = 0, mappedBytes = 0, windowBytes = 0, packedBytes = 0, textBytes = 0;
+    for (int i = 0; i < columnCount; i++) {
+        const Column *col = columns[i];
+        windowBytes += col->windows.bytes();
+        textBytes += col->maxTextRows * sizeof(Column::TextRow);
+        size_t valueBytes = col->capacity * sizeof(double) + (col->capacity / 64) * sizeof(uint64_t);
+        if (col->values == nullptr) {
+            packedBytes += col->packed.bytes();
+            valueBytes = (col->capacity / 64) * sizeof(uint64_t) + col->packed.bytes();
+        }
+        if (col->mapped)
+            mappedBytes += valueBytes;
+        else
+            columnBytes += valueBytes;
+        columnBytes += col->maxRefs * sizeof(SeriesRef);
+    }
+    size_t buildBytes = 0;
+    for (int i = -1; i < buildCacheCount; i++) {
+        const BuildTable &t = (i < 0) ? build : buildCache[i];
+        buildBytes += t.capacity * sizeof(Entry *) + t.size * sizeof(Entry);
+    }
+    oss << "memory series_bytes " << seriesBytes << " column_bytes " << columnBytes
+        << " mapped_bytes " << mappedBytes << " packed_bytes " << packedBytes << " text_bytes " << textBytes
+        << " window_bytes " << windowBytes
+        << " build_bytes " << buildBytes
+        << " arena_bytes " << arena.bytesReserved() << " string_bytes " << strings.bytes();
+    return oss.str();
+#else
+    return "failure";
+#endif
 }
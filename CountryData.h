@@ -2,8 +2,93 @@
 #define COUNTRY_DATA_H
 
 #include <string>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "Stats.h"
+#include "Arena.h"
+#include "WindowIndex.h"
+#include "PackedValues.h"
+#include "StringPool.h"
 
-static const int MAX_COUNTRIES = 512;
+class MappedFile;
+class SnapshotReader;
+class RowIndex;
+struct RowRun;
+
+// The hash table starts with this many slots and doubles as it fills (always a power of two).
+static const int INITIAL_TABLE_SIZE = 512;
+// Grow once live countries exceed this fraction of the slots; rehash in place
+// when live countries plus tombstones do.
+static const double MAX_LOAD_FACTOR = 0.75;
+// Rehash in place once tombstones exceed this fraction of the slots.
+static const double MAX_TOMBSTONE_RATIO = 0.25;
+
+// Number of recent builds kept (besides the active one) so BUILD can switch back instantly.
+static const int BUILD_CACHE_SIZE = 8;
+
+// A parallel LOAD gives each thread at least this many bytes of the file.
+static const size_t MIN_LOAD_CHUNK_BYTES = 1 << 20;
+// A parallel BUILD cuts the slot range into this many chunks per thread, so a thread
+// that finishes early takes more, and only runs for codes with at least this many series.
+static const int BUILD_CHUNKS_PER_THREAD = 8;
+static const int MIN_PARALLEL_BUILD_REFS = 4096;
+
+// Every series starts at this year; value i of a series belongs to BASE_YEAR + i.
+static const int BASE_YEAR = 1960;
+// Columns smaller than this are never compacted; the dead space is not worth reclaiming.
+static const int COMPACT_MIN_VALUES = 4096;
+
+// Country codes are three uppercase letters, read as a base-26 number below CODE_SPACE.
+static constexpr int CODE_SPACE = 26 * 26 * 26;
+
+// Value 0-25 of each letter byte 'A'-'Z', -1 for every other byte.
+struct CodeLetters {
+    signed char value[256];
+    constexpr CodeLetters() : value() {
+        for (int c = 0; c < 256; c++)
+            value[c] = (c >= 'A' && c <= 'Z') ? (signed char)(c - 'A') : (signed char)-1;
+    }
+};
+static constexpr CodeLetters CODE_LETTERS;
+
+// The base-26 key of a country code, or -1 if it is not exactly three letters A-Z.
+constexpr int codeKey(std::string_view code) {
+    if (code.size() != 3)
+        return -1;
+    int a = CODE_LETTERS.value[(unsigned char)code[0]];
+    int b = CODE_LETTERS.value[(unsigned char)code[1]];
+    int c = CODE_LETTERS.value[(unsigned char)code[2]];
+    if ((a | b | c) < 0)
+        return -1;
+    return (a * 26 + b) * 26 + c;
+}
+static_assert(codeKey("AAA") == 0 && codeKey("ZZZ") == CODE_SPACE - 1, "codes span the key space");
+static_assert(codeKey("aBC") == -1 && codeKey("AB") == -1 && codeKey("AB1") == -1, "bad codes have no key");
+
+// Probing scheme of the country table, picked at build time. The default is double
+// hashing; -DCOUNTRYDATA_SWISS_TABLE probes 16-slot groups of one-byte control words
+// (a 7-bit fingerprint per occupied slot) and only touches a node on a fingerprint match.
+// LOOKUP then reports the number of groups probed. -DCOUNTRYDATA_DIRECT_TABLE gives every
+// possible code its own slot (CODE_SPACE of them, slot = key): no probing, no growth and no
+// tombstones, and LOOKUP always reports one search.
+#if defined(COUNTRYDATA_SWISS_TABLE) && defined(COUNTRYDATA_DIRECT_TABLE)
+#error "pick one of COUNTRYDATA_SWISS_TABLE and COUNTRYDATA_DIRECT_TABLE"
+#endif
+#if defined(COUNTRYDATA_SWISS_TABLE)
+static const char *const TABLE_SCHEME = "swiss";
+static const int FIRST_TABLE_SIZE = INITIAL_TABLE_SIZE;
+#elif defined(COUNTRYDATA_DIRECT_TABLE)
+static const char *const TABLE_SCHEME = "direct";
+static const int FIRST_TABLE_SIZE = CODE_SPACE;
+#else
+static const char *const TABLE_SCHEME = "double-hashing";
+static const int FIRST_TABLE_SIZE = INITIAL_TABLE_SIZE;
+#endif
+
+// What BUILD reduces each country's series to, over every year or over a window of years.
+enum AggregateKind { AGG_MEAN, AGG_MIN, AGG_MAX, AGG_COUNT, AGG_STDDEV };
 
 // Slot status values (using simple integers)
 static const int STATUS_EMPTY = 0;
@@ -12,95 +97,366 @@ static const int STATUS_PREV_OCCUPIED = 2;
 
 class CountryData {
 private:
-    // 1) Series: Represents a time series record for a country.
-    struct Series {
-        std::string seriesName;
+    struct CountryNode;
+
+    // 1) SeriesRef: Secondary-index entry naming one country's series in a Column.
+    struct SeriesRef {
+        CountryNode *country;
+        int seriesIndex; // position in country->series
+    };
+
+    // 2) Column: Every country's values for one series code, stored back to back in one buffer.
+    //    After LOAD the buffer is swapped for a compressed copy in 'packed'; readers decode
+    //    it a block at a time through BlockCursor. The first write decodes it back into a
+    //    buffer, and the command that wrote packs it again (see repackColumns).
+    struct Column {
         std::string seriesCode;
-        int *years;
-        double *values;
-        int numEntries;
-        int maxEntries;
-        Series *next; // singly-linked list
+        int id;          // position in the columns array
+        double *values;     // missing values are stored as 0.0; nullptr while packed
+        uint64_t *validity; // bit i set = values[i] is real data
+        int size;        // values in use, including dead ones
+        int capacity;
+        int deadValues;  // values still in the buffer whose country has been removed
+        bool mapped;     // values/validity point into an OPENed snapshot; copied before any write
+        SeriesRef *refs; // every live (country, series) pair in this column, unordered
+        int numRefs;
+        int maxRefs;
+        WindowIndex windows;  // window aggregates of the live slices, built on first use
+        bool windowsCurrent;  // every live slice is indexed in 'windows'
+        PackedValues packed;  // the values, compressed, while 'values' is nullptr
+        int dirtyFrom;        // first value written since 'packed' was last brought up to date
+        uint32_t codeId;      // seriesCode's id in 'strings'
+
+        // Lazy LOAD: one row's value fields, still text in the LOAD file.
+        struct TextRow {
+            const char *fields;
+            size_t length;
+            int offset;       // where the row's values go in the column
+        };
+        TextRow *textRows;    // rows not parsed yet, in offset order; nullptr once parsed
+        int numTextRows;
+        int maxTextRows;
 
-        Series(const std::string &name, const std::string &code);
-        ~Series();
-        void resize();
+        // Reads values by index; a packed column is decoded one block at a time into
+        // 'block' instead of whole, so reading it needs no buffer of its full size.
+        struct BlockCursor {
+            const Column *col;
+            int decoded;        // the block held in 'block', or -1
+            double block[64];
+
+            explicit BlockCursor(const Column *c) : col(c), decoded(-1) {}
+            double at(int index);
+        };
+
+        Column(const std::string &code, int columnId);
+        ~Column();
+        void reserve(int extra);
+        void pack();
+        void addTextRow(std::string_view fields, int offset);
+        // Parse every text row into whole value/validity buffers (validity zeroed).
+        void parseText(double *out, uint64_t *outValidity) const;
+        const TextRow *findTextRow(int offset) const;
+        void append(double value, bool valid);
+        void set(int index, double value);
+        bool isValid(int index) const;
+        int addRef(CountryNode *c, int seriesIndex);
+        void removeRef(int index);
+    };
+
+    // 3) Series: One country's slice of a Column. Value i belongs to year BASE_YEAR + i.
+    //    Series and CountryNode live in the arena; their names are interned in 'strings', so
+    //    a series name shared by every country is stored once and a Series holds its id.
+    //    sum and count are running totals of the slice, kept current by APPEND; every
+    //    mean BUILD reports comes from them.
+    struct Series {
+        uint32_t nameId;  // series name, an id in 'strings'
+        Column *column;
+        int offset;      // index of the first value in column->values
+        int numEntries;
+        int refIndex;    // position of this series in column->refs
+        int count;       // number of valid values in the slice
+        double sum;      // sum of the valid values in the slice
     };
 
-    // 2) CountryNode: Represents one country and its data.
+    // 4) CountryNode: Represents one country and its data.
     struct CountryNode {
-        std::string countryName;
-        std::string countryCode;
-        Series *timeSeries; // linked list of series records
+        std::string_view countryName;  // interned: strings.get(nameId)
+        std::string_view countryCode;
+        uint32_t nameId;
+        int slot;        // current position in countryArray (kept up to date by hashing)
+        Series *series;  // arena array of series records, in file order
+        int numSeries;
+        int maxSeries;
 
-        CountryNode(const std::string &name, const std::string &code);
-        ~CountryNode();
+        CountryNode(std::string_view name, uint32_t nameId, std::string_view code);
+        Series &addSeries(Arena &arena);
     };
 
-    // 3) Entry: Used for the BUILD-related commands.
+    // 5) Entry: Used for the BUILD-related commands.
+    //    The name is the interned one, so it stays valid after its country is gone, and
+    //    entries are matched to countries by nameId.
     struct Entry {
-        std::string countryName;
-        double mean;  // computed as (sum of valid values)/(# valid values) or 0 if none
+        std::string_view countryName;
+        uint32_t nameId;
+        double mean;  // the build's aggregate over the valid values in its years (their mean
+                      // unless BUILD asked for another kind), or 0 if there are none
+    };
+
+    // 6) BuildTable: The entries built for one series code, sorted by (mean, countryName),
+    //    so queries are binary searches or reads of its ends.
+    struct BuildTable {
+        std::string seriesCode;
+        uint32_t codeId; // seriesCode's id in 'strings' (NO_STRING while no column has it)
+        int fromYear;    // inclusive window of years, or 0 and 0 for every year
+        int toYear;
+        AggregateKind kind;
+        Entry **entries;
+        int size;
+        int capacity;
+        unsigned long lastUsed;
+        bool complete;   // built from the whole table (not just INSERTs since a LOAD)
+
+        BuildTable();
+        bool sameKey(const std::string &code, int from, int to, AggregateKind k) const;
+        ~BuildTable();
+        void clear();
+        void swap(BuildTable &other);
+        static bool entryLess(const Entry *a, const Entry *b);
+        int lowerBoundMean(double value) const;
+        int upperBoundMean(double value) const;
+        void insert(Entry *e);
+        Entry *take(const Entry &key);
+        bool remove(const Entry &key);
+        bool removeName(uint32_t nameId);
     };
 
     // data Members 
 
+    // Every CountryNode, its series array and its names are allocated here; LOAD and OPEN
+    // drop them all with one reset.
+    Arena arena;
+    // Series names, series codes and country names, each stored once (in 'arena') and
+    // referred to by id. Cleared with the arena.
+    StringPool strings;
+
     // Hash table (array of CountryNode pointers) and an accompanying slot status array.
-    CountryNode *countryArray[MAX_COUNTRIES];
-    int slotStatus[MAX_COUNTRIES];
+    // Both hold tableSize slots and are reallocated when the table is rehashed.
+    CountryNode **countryArray;
+    int *slotStatus;
+    int tableSize;
     int countryCount;
+    int tombstoneCount; // slots in STATUS_PREV_OCCUPIED
+#ifdef COUNTRYDATA_SWISS_TABLE
+    uint8_t *control;   // per slot: CTRL_EMPTY, CTRL_DELETED or the fingerprint of its code
+#endif
 
     // for Project 3 commands that originally used a tree, we now build a dynamic array.
-    // This array is built by the BUILD command and used by RANGE, FIND, LIMITS, and DELETE (by country name).
-    Entry **buildEntries;
-    int buildSize;
-    int buildCapacity;  
-    std::string lastBuiltSeries;
+    // The active build is made by the BUILD command and used by RANGE, FIND, LIMITS, TOPK, PERCENTILE, and DELETE (by country name).
+    // The last few builds are kept in an LRU cache, so going back to one of them is a swap,
+    // and INSERT/REMOVE/DELETE keep every one of them current.
+    BuildTable build;
+    BuildTable buildCache[BUILD_CACHE_SIZE];
+    int buildCacheCount;
+    unsigned long buildClock; // stamps lastUsed on each BUILD
+
+    // Name index: country name -> CountryNode, open-addressed with its own status array.
+    CountryNode **nameIndex;
+    int *nameStatus;
+    int nameIndexSize;
+    int nameIndexUsed;  // occupied plus tombstone slots
+
+    // Number of threads LOAD parses with (1 = serial).
+    int loadThreads;
+    // Number of threads BUILD aggregates with (1 = serial).
+    int buildThreads;
+    // Lazy LOAD keeps the file mapped and each row's values as text until a command needs
+    // that series code's column (see parseColumn). The mapping stays open until the next
+    // LOAD or OPEN. It is shared, so both instances of a CountryDataServer can hold one read.
+    bool lazyLoad;
+    std::shared_ptr<MappedFile> loadFile;
+
+    // Column store: one Column per series code, plus an open-addressed code -> column index.
+    // Each Column's refs double as the series-code secondary index used by BUILD.
+    Column **columns;
+    int columnCount;
+    int columnCapacity;
+    Column **columnIndex;
+    int columnIndexSize;
+
+    // Snapshot mapped by OPEN. Columns read from it point straight into the mapping,
+    // so it stays open until the next LOAD or OPEN. Shared, like loadFile.
+    std::shared_ptr<MappedFile> snapshotFile;
+
+#ifdef COUNTRYDATA_STATS
+    // Counters for STATS; mutable so const queries (LOOKUP) can record into them.
+    mutable CommandStats stats;
+#endif
 
     // --- Hashing Helper Methods ---
-    unsigned int codeToInteger(const std::string &code) const;
+    unsigned int codeToInteger(std::string_view code) const;
+#if !defined(COUNTRYDATA_SWISS_TABLE) && !defined(COUNTRYDATA_DIRECT_TABLE)
     unsigned int h1(unsigned int W) const;
     unsigned int h2(unsigned int W) const;
+#endif
     bool hashInsert(CountryNode *newCountry);
-    std::pair<int,int> hashSearch(const std::string &code) const;
-    bool hashRemove(const std::string &code);
+    std::pair<int,int> hashSearch(std::string_view code) const;
+    bool hashRemove(std::string_view code);
+    void allocateTable(int size);
+    void freeTable();
+    void clearTable();
+    void placeNode(CountryNode *node);
+    CountryNode *newCountry(std::string_view name, std::string_view code);
+    void freeCountry(CountryNode *c);
+    void setSlot(unsigned int pos, CountryNode *node, int status);
+    void removeSlot(unsigned int pos);
+    void rehash(int newSize);
+
+    // --- Name Index Helper Methods ---
+    unsigned int nameHash(uint32_t nameId) const;
+    void allocateNameIndex(int size);
+    void rehashNameIndex(int newSize);
+    void nameIndexInsert(CountryNode *node);
+    void nameIndexRemove(CountryNode *node);
+    CountryNode *nameIndexFind(const std::string &name) const;
 
-    // --- Helper Methods for BUILD & Related Commands (no trees, just linear arrays) ---
-    // Build a dynamic array of Entry pointers (one per country with the specified series code).
-    bool buildStructure(const std::string &seriesCode);
+    // --- Helper Methods for BUILD & Related Commands (no trees, just sorted arrays) ---
+    // Build the active table of Entry pointers (one per country with the specified series code).
+    bool buildStructure(const std::string &seriesCode, int fromYear, int toYear, AggregateKind kind);
+    void buildChunk(Column *col, const BuildTable &t, SeriesRef *refs, int numRefs,
+                    Entry **out, int &numOut);
+    void appendNames(std::string &result, int from, int to) const;
+    void cacheActiveBuild();
+    void clearBuilds();
+    Entry *newEntry(const CountryNode *c, double mean) const;
+    void setBuildCode(BuildTable &t, const std::string &seriesCode);
+    // Keep the active and cached builds in step with countries entering or leaving the table.
+    void addToBuilds(const CountryNode *c);
+    void removeFromBuilds(const CountryNode *c);
+    // APPEND: country c gained its first series in col, or that series is about to change.
+    // taken[] has one slot per build (active first), for the entries lifted out meanwhile.
+    void addSeriesToBuilds(const CountryNode *c, Column *col);
+    void takeFromBuilds(const CountryNode *c, Column *col, Entry **taken);
+    void putBackInBuilds(const CountryNode *c, Column *col, Entry **taken);
     // Compute the global range (min and max mean) from the build array.
     std::string computeRange() const;
     // Return a space-separated list of country names from the build array that satisfy the condition.
     std::string computeFind(double mean, const std::string &op) const;
-    // Remove an entry (by country name) from the build array.
-    bool deleteFromBuild(const std::string &countryName);
     // Compute the limits (lowest or highest) from the build array.
     std::string computeLimits(const std::string &condition) const;
+    // The k highest or lowest entries of the build array, most extreme first.
+    std::string computeTopK(int k, const std::string &condition) const;
+    // The build's value at percentile p (nearest rank).
+    std::string computePercentile(double p) const;
     // Find a country (by name) in the hash table.
     std::string findCountry(const std::string &countryName) const;
-    // Free any previously built array.
-    void deleteBuildEntries();
 
-    // --- Modified LOAD: Reads a CSV file and uses hashing to store countries.
-    bool loadFromFile(const std::string &filename);
+    // --- Column store helpers ---
+    Column *findColumn(std::string_view code) const;
+    Column *getColumn(std::string_view code);
+    void indexColumn(Column *col);
+    void clearColumns();
+    Series &attachSeries(CountryNode *c, Column *col, std::string_view sName);
+    void releaseSeries(CountryNode *c);
+    void compactColumn(Column *col);
+    void packColumns();
+    void repackColumns();
+    void parseColumn(Column *col);
+    void seriesTotals(const Series &s, int &count, double &sum) const;
+    void sumSeries(Series &s) const;
+    double sliceMean(const Series &s) const;
+    void moveToTail(Column *col, Series &s, int extra);
+    void ensureWindows(Column *col);
+    void reindexSlice(Column *col, const Series &s);
+    double aggregate(Column *col, const Series &s, const BuildTable &t);
+    bool seriesValue(const CountryNode *c, Column *col, const BuildTable &t, double &value);
+
+    // --- Snapshot helpers ---
+    void closeSnapshot();
+    bool openFromFile(const std::shared_ptr<MappedFile> &file);
+    bool checkSnapshot(SnapshotReader in) const;
+    void restoreSnapshot(SnapshotReader &in);
+
+    // --- CSV parsing helpers shared by LOAD, INSERT and APPEND ---
+    void appendRow(CountryNode *c, std::string_view sName, std::string_view sCode, std::string_view fields);
+    void mergeRow(CountryNode *c, std::string_view sName, std::string_view sCode, std::string_view fields);
+    bool insertRuns(std::string_view code, const char *data, const RowRun *runs, int numRuns);
+    bool insertFromFile(const std::string &code, const MappedFile &file, const RowIndex *index);
+    int insertBatchFromFile(const std::vector<std::string> &codes, const MappedFile &file, const RowIndex &index);
+    void appendFromFile(const MappedFile &file);
+    CountryNode *findOrInsertCountry(std::string_view cName, std::string_view cCode);
+
+    // A row parsed by a LOAD worker, waiting to be merged into the hash table.
+    // Its values sit at [valueOffset, valueOffset + numValues) of its chunk's buffers.
+    struct ParsedRow {
+        std::string_view countryName;
+        std::string_view countryCode;
+        std::string_view seriesName;
+        std::string_view seriesCode;
+        size_t valueOffset;
+        int numValues;
+    };
+    struct ParsedChunk {
+        std::vector<ParsedRow> rows;
+        std::vector<double> values;
+        std::vector<bool> valid;
+    };
+    void parseChunk(const char *begin, const char *end, ParsedChunk &chunk) const;
+
+    // --- Modified LOAD: Memory-maps a CSV file and uses hashing to store countries.
+    bool loadFromFile(const MappedFile &file);
+    bool deferFromFile(const std::shared_ptr<MappedFile> &file);
+    void deferRow(CountryNode *c, std::string_view sName, std::string_view sCode, std::string_view fields);
+    void clearForLoad();
+    void closeLoadFile();
 
 public:
     CountryData();
     ~CountryData();
+    CountryData(const CountryData &) = delete;
+    CountryData &operator=(const CountryData &) = delete;
 
     // Project 3 Commands (maintained, implemented via hashing and linear scans) 
     bool load(const std::string &filename);              // LOAD
-    bool buildCommand(const std::string &seriesCode);      // BUILD
-    std::string rangeCommand(const std::string &seriesCode); // RANGE
-    std::string listCommand(const std::string &countryName); // LIST
-    std::string findCommand(double mean, const std::string &op); // FIND
+    void setLoadThreads(int threads);                    // threads used by LOAD (default 1)
+    void setBuildThreads(int threads);                   // threads used by BUILD (default 1)
+    void setLazyLoad(bool lazy);                         // parse values on first use (default off)
+    bool buildCommand(const std::string &seriesCode, int fromYear = 0, int toYear = 0,
+                      AggregateKind kind = AGG_MEAN);        // BUILD
+    static bool parseAggregate(const std::string &name, AggregateKind &kind);
+    std::string rangeCommand(const std::string &seriesCode) const; // RANGE
+    std::string listCommand(const std::string &countryName) const; // LIST
+    std::string findCommand(double mean, const std::string &op) const; // FIND
     bool deleteCommand(const std::string &countryName);    // DELETE (by country name)
-    std::string limitsCommand(const std::string &condition); // LIMITS
+    std::string limitsCommand(const std::string &condition) const; // LIMITS
+    std::string topkCommand(int k, const std::string &condition) const; // TOPK
+    std::string percentileCommand(double p) const;         // PERCENTILE
 
     // Project 4 Commands
     bool insertCommand(const std::string &code, const std::string &filename); // INSERT
+    // INSERT of many codes in one pass over the file; an empty list means every code in the
+    // file that is not in the table. Returns the number of countries inserted.
+    int insertBatchCommand(const std::vector<std::string> &codes, const std::string &filename);
+    bool indexCommand(const std::string &filename) const;                     // INDEX
     std::pair<int,int> lookupCommand(const std::string &code) const;          // LOOKUP
     bool removeCommand(const std::string &code);                              // REMOVE
+    bool appendCommand(const std::string &filename);                          // APPEND
+
+    // Binary snapshots
+    bool saveCommand(const std::string &filename) const;  // SAVE
+    bool openCommand(const std::string &filename);        // OPEN
+
+    // LOAD, INSERT, APPEND and OPEN on input the caller has already read, so the same bytes
+    // can be applied to more than one instance (see CountryDataServer). INSERT takes the
+    // sidecar index, or nullptr to scan the file; INSERT of many codes needs one, loaded
+    // or built.
+    bool load(const std::shared_ptr<MappedFile> &file);
+    bool insertCommand(const std::string &code, const MappedFile &file, const RowIndex *index);
+    int insertBatchCommand(const std::vector<std::string> &codes, const MappedFile &file, const RowIndex &index);
+    bool appendCommand(const MappedFile &file);
+    bool openCommand(const std::shared_ptr<MappedFile> &file);
+
+    // Instrumentation report (failure unless built with COUNTRYDATA_STATS)
+    std::string statsCommand() const;                     // STATS
 };
 
 #endif
@@ -0,0 +1,164 @@
+#include "CountryDataServer.h"
+#include "CsvReader.h"
+#include "RowIndex.h"
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+CountryDataServer::CountryDataServer() : published(0), lazyLoad(false) {
+    for (int s = 0; s < SERVER_READER_SLOTS; s++) {
+        slots[s].inside[0].store(0, std::memory_order_relaxed);
+        slots[s].inside[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Threads get slots round-robin the first time they read.
+CountryDataServer::ReaderSlot &CountryDataServer::mySlot() const {
+    static std::atomic<unsigned int> nextSlot(0);
+    thread_local unsigned int slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % SERVER_READER_SLOTS;
+    return slots[slot];
+}
+
+// Register in the published instance. If a writer switched instances between reading
+// 'published' and registering, back out and try again: the writer may already be
+// waiting on (or past) the old instance.
+int CountryDataServer::enter(ReaderSlot &slot) const {
+    while (true) {
+        int i = published.load(std::memory_order_seq_cst);
+        slot.inside[i].fetch_add(1, std::memory_order_seq_cst);
+        if (published.load(std::memory_order_seq_cst) == i)
+            return i;
+        slot.inside[i].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Wait until no reader is left in 'instance'. New readers only enter the published one.
+void CountryDataServer::waitForReaders(int instance) const {
+    for (int s = 0; s < SERVER_READER_SLOTS; s++) {
+        while (slots[s].inside[instance].load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+    }
+}
+
+// The two instances gave different results for one command, so from now on readers would
+// get different answers depending on which one is published. Nothing can put them back
+// in step, so stop rather than serve that.
+void CountryDataServer::replayDiverged() {
+    std::cerr << "CountryDataServer: instances diverged on a replayed command" << std::endl;
+    std::abort();
+}
+
+// Writers
+void CountryDataServer::setLoadThreads(int threads) {
+    std::lock_guard<std::mutex> lock(writeLock);
+    instances[0].setLoadThreads(threads);
+    instances[1].setLoadThreads(threads);
+}
+
+void CountryDataServer::setBuildThreads(int threads) {
+    std::lock_guard<std::mutex> lock(writeLock);
+    instances[0].setBuildThreads(threads);
+    instances[1].setBuildThreads(threads);
+}
+
+void CountryDataServer::setLazyLoad(bool lazy) {
+    std::lock_guard<std::mutex> lock(writeLock);
+    instances[0].setLazyLoad(lazy);
+    instances[1].setLazyLoad(lazy);
+    lazyLoad.store(lazy, std::memory_order_relaxed);
+}
+
+// Commands that read a file get it mapped once, here, and both instances read that mapping.
+bool CountryDataServer::load(const std::string &filename) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename, !lazyLoad.load(std::memory_order_relaxed)))
+        return false;
+    return write([&](CountryData &d) { return d.load(file); });
+}
+
+bool CountryDataServer::buildCommand(const std::string &seriesCode, int fromYear, int toYear,
+                                     AggregateKind kind) {
+    return write([&](CountryData &d) { return d.buildCommand(seriesCode, fromYear, toYear, kind); });
+}
+
+bool CountryDataServer::deleteCommand(const std::string &countryName) {
+    return write([&](CountryData &d) { return d.deleteCommand(countryName); });
+}
+
+bool CountryDataServer::insertCommand(const std::string &code, const std::string &filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    RowIndex index;
+    const RowIndex *sidecar = index.load(filename) ? &index : nullptr;
+    return write([&](CountryData &d) { return d.insertCommand(code, file, sidecar); });
+}
+
+int CountryDataServer::insertBatchCommand(const std::vector<std::string> &codes, const std::string &filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return 0;
+    RowIndex index;
+    if (!index.load(filename))
+        index.build(file.data(), file.size());
+    return write([&](CountryData &d) { return d.insertBatchCommand(codes, file, index); });
+}
+
+bool CountryDataServer::removeCommand(const std::string &code) {
+    return write([&](CountryData &d) { return d.removeCommand(code); });
+}
+
+bool CountryDataServer::appendCommand(const std::string &filename) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    return write([&](CountryData &d) { return d.appendCommand(file); });
+}
+
+bool CountryDataServer::openCommand(const std::string &filename) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename, false))
+        return false;
+    return write([&](CountryData &d) { return d.openCommand(file); });
+}
+
+// Readers
+std::string CountryDataServer::rangeCommand(const std::string &seriesCode) const {
+    return read([&](const CountryData &d) { return d.rangeCommand(seriesCode); });
+}
+
+std::string CountryDataServer::listCommand(const std::string &countryName) const {
+    return read([&](const CountryData &d) { return d.listCommand(countryName); });
+}
+
+std::string CountryDataServer::findCommand(double mean, const std::string &op) const {
+    return read([&](const CountryData &d) { return d.findCommand(mean, op); });
+}
+
+std::string CountryDataServer::limitsCommand(const std::string &condition) const {
+    return read([&](const CountryData &d) { return d.limitsCommand(condition); });
+}
+
+std::string CountryDataServer::topkCommand(int k, const std::string &condition) const {
+    return read([&](const CountryData &d) { return d.topkCommand(k, condition); });
+}
+
+std::string CountryDataServer::percentileCommand(double p) const {
+    return read([&](const CountryData &d) { return d.percentileCommand(p); });
+}
+
+std::pair<int,int> CountryDataServer::lookupCommand(const std::string &code) const {
+    return read([&](const CountryData &d) { return d.lookupCommand(code); });
+}
+
+bool CountryDataServer::saveCommand(const std::string &filename) const {
+    return read([&](const CountryData &d) { return d.saveCommand(filename); });
+}
+
+bool CountryDataServer::indexCommand(const std::string &filename) const {
+    return read([&](const CountryData &d) { return d.indexCommand(filename); });
+}
+
+std::string CountryDataServer::statsCommand() const {
+    return read([&](const CountryData &d) { return d.statsCommand(); });
+}
@@ -0,0 +1,100 @@
+#ifndef COUNTRY_DATA_SERVER_H
+#define COUNTRY_DATA_SERVER_H
+
+#include "CountryData.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+// Reader slots: each reading thread counts itself in one of these, so readers on
+// different cores do not fight over a single counter.
+static const int SERVER_READER_SLOTS = 64;
+
+// CountryDataServer: serves CountryData queries from many threads while LOAD, INSERT,
+// APPEND, REMOVE, DELETE, BUILD and OPEN run.
+//
+// It keeps two identical CountryData instances (left-right). Readers use whichever one
+// is published and never block. A writer applies its command to the other instance,
+// publishes it atomically, waits for readers still in the old one to leave, then applies
+// the same command there so both agree again. Writers are serialized and pay for every
+// command twice; readers always see a complete version, never one in the middle of a write.
+//
+// Replaying a command must leave both instances the same, so a command that reads a file
+// (LOAD, INSERT, APPEND, OPEN) maps it, and any sidecar index, once and hands both
+// instances that one mapping; the file is never opened a second time for the replay.
+// Each instance counts its own STATS, so a writer's command is counted (and timed) in both,
+// and STATS reports only what the published instance saw.
+class CountryDataServer {
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<long> inside[2];  // readers currently in instance 0 / 1
+    };
+
+    CountryData instances[2];
+    std::atomic<int> published;     // index of the instance readers use
+    mutable ReaderSlot slots[SERVER_READER_SLOTS];
+    std::mutex writeLock;
+    std::atomic<bool> lazyLoad;     // as set on both instances; only picks how LOAD maps its file
+
+    ReaderSlot &mySlot() const;
+    int enter(ReaderSlot &slot) const;
+    void waitForReaders(int instance) const;
+
+    // Run a const query against the published instance.
+    template <class Query>
+    auto read(Query query) const -> decltype(query(instances[0])) {
+        ReaderSlot &slot = mySlot();
+        int i = enter(slot);
+        auto result = query(static_cast<const CountryData &>(instances[i]));
+        slot.inside[i].fetch_sub(1, std::memory_order_release);
+        return result;
+    }
+
+    // Apply a command to both instances, one at a time, publishing the first. The replay
+    // must give the same result; if it does not, the instances no longer agree.
+    template <class Command>
+    auto write(Command command) -> decltype(command(instances[0])) {
+        std::lock_guard<std::mutex> lock(writeLock);
+        int standby = 1 - published.load(std::memory_order_relaxed);
+        auto result = command(instances[standby]);
+        published.store(standby, std::memory_order_seq_cst);
+        waitForReaders(1 - standby);
+        if (command(instances[1 - standby]) != result)
+            replayDiverged();
+        return result;
+    }
+    [[noreturn]] static void replayDiverged();
+
+public:
+    CountryDataServer();
+    CountryDataServer(const CountryDataServer &) = delete;
+    CountryDataServer &operator=(const CountryDataServer &) = delete;
+
+    // Writers
+    void setLoadThreads(int threads);
+    void setBuildThreads(int threads);
+    void setLazyLoad(bool lazy);
+    bool load(const std::string &filename);
+    bool buildCommand(const std::string &seriesCode, int fromYear = 0, int toYear = 0,
+                      AggregateKind kind = AGG_MEAN);
+    bool deleteCommand(const std::string &countryName);
+    bool insertCommand(const std::string &code, const std::string &filename);
+    int insertBatchCommand(const std::vector<std::string> &codes, const std::string &filename);
+    bool removeCommand(const std::string &code);
+    bool appendCommand(const std::string &filename);
+    bool openCommand(const std::string &filename);
+
+    // Readers
+    std::string rangeCommand(const std::string &seriesCode) const;
+    std::string listCommand(const std::string &countryName) const;
+    std::string findCommand(double mean, const std::string &op) const;
+    std::string limitsCommand(const std::string &condition) const;
+    std::string topkCommand(int k, const std::string &condition) const;
+    std::string percentileCommand(double p) const;
+    std::pair<int,int> lookupCommand(const std::string &code) const;
+    bool saveCommand(const std::string &filename) const;
+    bool indexCommand(const std::string &filename) const;
+    std::string statsCommand() const;
+};
+
+#endif
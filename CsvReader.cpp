@@ -0,0 +1,102 @@
+#include "CsvReader.h"
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// MAPPEDFILE IMPLEMENTATION
+MappedFile::MappedFile() : fd(-1), addr(nullptr), length(0) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &filename, bool sequential) {
+    close();
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close();
+        return false;
+    }
+    length = (size_t)st.st_size;
+    if (length == 0)
+        return true; // mmap rejects empty mappings; an empty file is just an empty buffer
+    void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    madvise(p, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    addr = static_cast<const char *>(p);
+    return true;
+}
+
+void MappedFile::close() {
+    if (addr != nullptr)
+        munmap(const_cast<char *>(addr), length);
+    if (fd != -1)
+        ::close(fd);
+    fd = -1;
+    addr = nullptr;
+    length = 0;
+}
+
+// CSVCURSOR IMPLEMENTATION
+bool CsvCursor::nextLine(std::string_view &line) {
+    while (pos < end) {
+        const char *start = pos;
+        const char *nl = static_cast<const char *>(memchr(start, '\n', end - start));
+        const char *stop = (nl != nullptr) ? nl : end;
+        pos = (nl != nullptr) ? nl + 1 : end;
+        if (stop > start && stop[-1] == '\r')
+            stop--;
+        if (stop > start) {
+            line = std::string_view(start, stop - start);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CsvCursor::nextField(std::string_view &rest, std::string_view &field) {
+    if (rest.empty()) {
+        field = std::string_view();
+        return false;
+    }
+    size_t comma = rest.find(',');
+    if (comma == std::string_view::npos) {
+        field = rest;
+        rest = std::string_view();
+    } else {
+        field = rest.substr(0, comma);
+        rest.remove_prefix(comma + 1);
+    }
+    return true;
+}
+
+bool CsvCursor::parseValue(std::string_view field, double &value) {
+    const char *first = field.data();
+    const char *last = first + field.size();
+    while (first < last && (*first == ' ' || *first == '\t'))
+        first++;
+    if (first < last && *first == '+')
+        first++;
+    value = 0.0;
+    if (first == last)
+        return false;
+    // A bare "-1" is the file format's marker for a missing value.
+    if (last - first == 2 && first[0] == '-' && first[1] == '1')
+        return false;
+    std::from_chars_result r = std::from_chars(first, last, value);
+    if (r.ec != std::errc()) {
+        value = 0.0;
+        return false;
+    }
+    return true;
+}
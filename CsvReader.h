@@ -0,0 +1,57 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// MappedFile: a read-only memory mapping of an entire file.
+// The mapping stays valid until close() or destruction.
+class MappedFile {
+private:
+    int fd;
+    const char *addr;
+    size_t length;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // 'sequential' hints that the file will be read front to back once (LOAD, INSERT);
+    // otherwise it is accessed at random for as long as it stays mapped (OPEN).
+    bool open(const std::string &filename, bool sequential = true);
+    void close();
+    bool isOpen() const { return fd != -1; }
+    const char *data() const { return addr; }
+    size_t size() const { return length; }
+};
+
+// CsvCursor: walks the lines of a buffer and splits them into fields in place.
+// Nothing is copied; every field is a view into the underlying buffer.
+class CsvCursor {
+private:
+    const char *pos;
+    const char *end;
+
+public:
+    CsvCursor(const char *begin, const char *finish) : pos(begin), end(finish) {}
+
+    // Returns the next non-empty line (without the line terminator), or false at end of buffer.
+    bool nextLine(std::string_view &line);
+    const char *position() const { return pos; }
+
+    // Pops the next comma-separated field off the front of 'rest'.
+    // Mirrors std::getline(ss, field, ','): returns false once 'rest' is exhausted,
+    // so a trailing comma does not produce an extra empty field.
+    static bool nextField(std::string_view &rest, std::string_view &field);
+
+    // Parses one data value. Returns false (and sets value to 0) for a missing value:
+    // an empty field, the literal "-1" marker, or unparsable text. Any other number,
+    // including -1.0, is real data.
+    static bool parseValue(std::string_view field, double &value);
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include "PackedValues.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const int MAX_EXPONENT = 15;
+static const double POW10[MAX_EXPONENT + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+static const double DECIMAL_LIMIT = 4503599627370496.0;  // 2^52
+
+static uint64_t bitsOf(double v) {
+    uint64_t b;
+    memcpy(&b, &v, sizeof b);
+    return b;
+}
+
+static double doubleOf(uint64_t b) {
+    double v;
+    memcpy(&v, &b, sizeof v);
+    return v;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// v is exactly n / 10^e (bit for bit, so -0.0, NaN and infinities never are).
+static bool exactAt(double v, int e, int64_t &n) {
+    double scaled = v * POW10[e];
+    if (!(std::fabs(scaled) < DECIMAL_LIMIT))
+        return false;
+    n = std::llrint(scaled);
+    return bitsOf((double)n / POW10[e]) == bitsOf(v);
+}
+
+// Clear the validity bits past the last value.
+static uint64_t inRange(uint64_t valid, int b, int size) {
+    int inBlock = size - b * 64;
+    return (inBlock < 64) ? valid & ((1ULL << inBlock) - 1) : valid;
+}
+
+// Reads the bit stream from a given position.
+struct BitReader {
+    const uint64_t *words;
+    size_t pos;
+
+    uint64_t get(int bits) {
+        if (bits == 0)
+            return 0;
+        size_t w = pos >> 6;
+        int s = (int)(pos & 63);
+        uint64_t v = words[w] >> s;
+        if (s + bits > 64)
+            v |= words[w + 1] << (64 - s);
+        if (bits < 64)
+            v &= (1ULL << bits) - 1;
+        pos += bits;
+        return v;
+    }
+};
+
+// PACKEDVALUES IMPLEMENTATION
+PackedValues::PackedValues()
+    : words(nullptr), usedBits(0), capacityWords(0), blockStart(nullptr), numBlocks(0), numValues(0)
+{
+}
+
+PackedValues::~PackedValues() {
+    clear();
+}
+
+void PackedValues::clear() {
+    delete[] words;
+    delete[] blockStart;
+    words = nullptr;
+    blockStart = nullptr;
+    usedBits = 0;
+    capacityWords = 0;
+    numBlocks = 0;
+    numValues = 0;
+}
+
+// Bits go in low to high within each word; the stream is zeroed as it grows.
+void PackedValues::put(uint64_t value, int bits) {
+    if (bits == 0)
+        return;
+    if (bits < 64)
+        value &= (1ULL << bits) - 1;
+    size_t needed = (usedBits + bits + 63) / 64;
+    if (needed > capacityWords) {
+        size_t newCapacity = (capacityWords == 0) ? 64 : capacityWords * 2;
+        while (newCapacity < needed)
+            newCapacity *= 2;
+        uint64_t *grown = new uint64_t[newCapacity];
+        if (words != nullptr)
+            memcpy(grown, words, capacityWords * sizeof(uint64_t));
+        memset(grown + capacityWords, 0, (newCapacity - capacityWords) * sizeof(uint64_t));
+        delete[] words;
+        words = grown;
+        capacityWords = newCapacity;
+    }
+    size_t w = usedBits >> 6;
+    int s = (int)(usedBits & 63);
+    words[w] |= value << s;
+    if (s + bits > 64)
+        words[w + 1] |= value >> (64 - s);
+    usedBits += bits;
+}
+
+// Block layout: a mode bit, then
+//  decimal (1): exponent e (4 bits), delta width (6 bits), the first n (64 bits), then
+//               each following n as a zigzag delta of 'width' bits;
+//  xor (0):     the first value (64 bits), then per value '0' if it repeats the previous
+//               one, '10' + the changed bits if they fit the previous value's window, or
+//               '11' + leading zeros (5 bits) + length - 1 (6 bits) + the changed bits.
+void PackedValues::encodeBlock(const double *values, uint64_t valid) {
+    double v[64];
+    int k = 0;
+    for (uint64_t bits = valid; bits != 0; bits &= bits - 1)
+        v[k++] = values[__builtin_ctzll(bits)];
+    if (k == 0)
+        return;
+
+    int64_t n[64];
+    int e = 0;
+    bool decimal = true;
+    for (int i = 0; i < k && decimal; i++) {
+        while (e <= MAX_EXPONENT && !exactAt(v[i], e, n[i]))
+            e++;
+        decimal = (e <= MAX_EXPONENT);
+    }
+    // A larger exponent chosen for a later value must still fit the earlier ones.
+    for (int i = 0; i < k && decimal; i++)
+        decimal = exactAt(v[i], e, n[i]);
+
+    if (decimal) {
+        uint64_t widest = 0;
+        for (int i = 1; i < k; i++)
+            widest |= zigzag(n[i] - n[i - 1]);
+        int width = (widest == 0) ? 0 : 64 - __builtin_clzll(widest);
+        put(1, 1);
+        put((uint64_t)e, 4);
+        put((uint64_t)width, 6);
+        put((uint64_t)n[0], 64);
+        for (int i = 1; i < k; i++)
+            put(zigzag(n[i] - n[i - 1]), width);
+        return;
+    }
+
+    put(0, 1);
+    uint64_t prev = bitsOf(v[0]);
+    put(prev, 64);
+    int windowLead = 0, windowLength = 0;
+    for (int i = 1; i < k; i++) {
+        uint64_t cur = bitsOf(v[i]);
+        uint64_t x = cur ^ prev;
+        prev = cur;
+        if (x == 0) {
+            put(0, 1);
+            continue;
+        }
+        int lead = __builtin_clzll(x);
+        int trail = __builtin_ctzll(x);
+        if (lead > 31)
+            lead = 31;
+        if (windowLength > 0 && lead >= windowLead && trail >= 64 - windowLead - windowLength) {
+            put(0b01, 2);
+            put(x >> (64 - windowLead - windowLength), windowLength);
+        } else {
+            windowLead = lead;
+            windowLength = 64 - lead - trail;
+            put(0b11, 2);
+            put((uint64_t)windowLead, 5);
+            put((uint64_t)(windowLength - 1), 6);
+            put(x >> trail, windowLength);
+        }
+    }
+}
+
+void PackedValues::encode(const double *values, const uint64_t *validity, int size) {
+    clear();
+    encodeFrom(values, validity, size, 0);
+}
+
+// Blocks before firstBlock are kept as they are; the stream is cut where firstBlock began
+// and everything from there on is coded again.
+void PackedValues::encodeFrom(const double *values, const uint64_t *validity, int size, int firstBlock) {
+    int newBlocks = (size + 63) / 64;
+    firstBlock = std::min(firstBlock, std::min(numBlocks, newBlocks));
+    if (firstBlock < numBlocks) {
+        // put() ORs bits in, so the cut-off part of the stream must be zero again.
+        usedBits = blockStart[firstBlock];
+        size_t w = usedBits >> 6;
+        if (w < capacityWords) {
+            words[w] &= (usedBits & 63) ? (1ULL << (usedBits & 63)) - 1 : 0;
+            memset(words + w + 1, 0, (capacityWords - w - 1) * sizeof(uint64_t));
+        }
+    }
+    if (newBlocks != numBlocks) {
+        uint64_t *starts = (newBlocks > 0) ? new uint64_t[newBlocks] : nullptr;
+        if (firstBlock > 0)
+            memcpy(starts, blockStart, firstBlock * sizeof(uint64_t));
+        delete[] blockStart;
+        blockStart = starts;
+    }
+    numBlocks = newBlocks;
+    numValues = size;
+    for (int b = firstBlock; b < numBlocks; b++) {
+        blockStart[b] = usedBits;
+        encodeBlock(values + (size_t)b * 64, inRange(validity[b], b, size));
+    }
+    // Drop the growth slack; the stream is only read until the next write to the column.
+    size_t usedWords = (usedBits + 63) / 64;
+    if (usedWords < capacityWords) {
+        uint64_t *exact = (usedWords > 0) ? new uint64_t[usedWords] : nullptr;
+        if (usedWords > 0)
+            memcpy(exact, words, usedWords * sizeof(uint64_t));
+        delete[] words;
+        words = exact;
+        capacityWords = usedWords;
+    }
+}
+
+void PackedValues::decodeBlock(int b, const uint64_t *validity, double *out) const {
+    for (int i = 0; i < 64; i++)
+        out[i] = 0.0;
+    uint64_t valid = inRange(validity[b], b, numValues);
+    if (valid == 0)
+        return;
+    BitReader in = { words, (size_t)blockStart[b] };
+    int slot = __builtin_ctzll(valid);
+    valid &= valid - 1;
+
+    if (in.get(1) == 1) {
+        int e = (int)in.get(4);
+        int width = (int)in.get(6);
+        int64_t n = (int64_t)in.get(64);
+        out[slot] = (double)n / POW10[e];
+        for (; valid != 0; valid &= valid - 1) {
+            n += unzigzag(in.get(width));
+            out[__builtin_ctzll(valid)] = (double)n / POW10[e];
+        }
+        return;
+    }
+
+    uint64_t prev = in.get(64);
+    out[slot] = doubleOf(prev);
+    int windowLead = 0, windowLength = 0;
+    for (; valid != 0; valid &= valid - 1) {
+        if (in.get(1) == 1) {
+            if (in.get(1) == 1) {
+                windowLead = (int)in.get(5);
+                windowLength = (int)in.get(6) + 1;
+            }
+            prev ^= in.get(windowLength) << (64 - windowLead - windowLength);
+        }
+        out[__builtin_ctzll(valid)] = doubleOf(prev);
+    }
+}
+
+void PackedValues::decode(const uint64_t *validity, int size, double *out) const {
+    double tail[64];
+    for (int b = 0; b < numBlocks; b++) {
+        size_t first = (size_t)b * 64;
+        if (first + 64 <= (size_t)size) {
+            decodeBlock(b, validity, out + first);
+        } else {
+            decodeBlock(b, validity, tail);
+            memcpy(out + first, tail, (size - first) * sizeof(double));
+        }
+    }
+}
+
+size_t PackedValues::bytes() const {
+    return capacityWords * sizeof(uint64_t) + (size_t)numBlocks * sizeof(uint64_t);
+}
@@ -0,0 +1,52 @@
+#ifndef PACKED_VALUES_H
+#define PACKED_VALUES_H
+
+#include <cstddef>
+#include <cstdint>
+
+// PackedValues: a compressed copy of a value buffer and its validity bitmap, for
+// columns nobody is writing to.
+//
+// Values are coded in blocks of 64, one per validity word, so any block decodes on its
+// own. Only valid values are stored; missing ones come back as 0.0. Each block uses one
+// of two lossless codings:
+//  - decimal: when every value in the block is exactly n / 10^e for integers n that fit
+//    in 52 bits (true of most parsed CSV text), the n are stored as zigzag deltas,
+//    bit-packed at the block's widest delta;
+//  - xor: otherwise, Gorilla-style XOR against the previous value, storing only the
+//    bits that changed.
+class PackedValues {
+private:
+    uint64_t *words;       // the bit stream, blocks back to back
+    size_t usedBits;
+    size_t capacityWords;
+    uint64_t *blockStart;  // bit offset of each block in 'words'
+    int numBlocks;
+    int numValues;
+
+    PackedValues(const PackedValues &) = delete;
+    PackedValues &operator=(const PackedValues &) = delete;
+
+    void put(uint64_t value, int bits);
+    void encodeBlock(const double *values, uint64_t valid);
+
+public:
+    PackedValues();
+    ~PackedValues();
+
+    // Replace the contents with values[0, size) (validity has (size + 63) / 64 words).
+    void encode(const double *values, const uint64_t *validity, int size);
+    // Bring the contents up to date with values[0, size) after a write, coding again only
+    // blocks firstBlock onward; the values and validity of earlier blocks must not have
+    // changed since they were encoded.
+    void encodeFrom(const double *values, const uint64_t *validity, int size, int firstBlock);
+    // Decode block b (values [64b, 64b + 64)) into out[0, 64).
+    void decodeBlock(int b, const uint64_t *validity, double *out) const;
+    // Decode the first 'size' values into out.
+    void decode(const uint64_t *validity, int size, double *out) const;
+    void clear();
+    bool empty() const { return numBlocks == 0; }
+    size_t bytes() const;
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "RowIndex.h"
+#include "CsvReader.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <unordered_map>
+#include <sys/stat.h>
+
+static const char *const ROW_INDEX_TAG = "rowindex";
+
+// The CSV's size and modification time, which a sidecar must match to be used.
+static bool sourceStamp(const std::string &csvFilename, int64_t stamp[3]) {
+    struct stat st;
+    if (stat(csvFilename.c_str(), &st) != 0)
+        return false;
+    stamp[0] = (int64_t)st.st_size;
+    stamp[1] = (int64_t)st.st_mtim.tv_sec;
+    stamp[2] = (int64_t)st.st_mtim.tv_nsec;
+    return true;
+}
+
+// ROWINDEX IMPLEMENTATION
+RowIndex::RowIndex() : sourceSize(0) {
+}
+
+void RowIndex::sortCodes() {
+    byCode.resize(codes.size());
+    for (size_t i = 0; i < codes.size(); i++)
+        byCode[i] = (uint32_t)i;
+    std::sort(byCode.begin(), byCode.end(), [this](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+}
+
+// One pass: every line's code is read, and consecutive lines with the same code share a
+// run. The runs are then grouped by code, keeping file order within each code.
+void RowIndex::build(const char *data, size_t size) {
+    codes.clear();
+    runs.clear();
+    sourceSize = size;
+    std::vector<RowRun> found;
+    std::vector<uint32_t> owner;
+    std::unordered_map<std::string_view, uint32_t> positions;
+    CsvCursor cursor(data, data + size);
+    std::string_view line, cName, cCode;
+    while (cursor.nextLine(line)) {
+        CsvCursor::nextField(line, cName);
+        CsvCursor::nextField(line, cCode);
+        uint64_t start = (uint64_t)(cName.data() - data);
+        uint64_t stop = (uint64_t)(cursor.position() - data);
+        auto it = positions.find(cCode);
+        uint32_t i;
+        if (it == positions.end()) {
+            i = (uint32_t)codes.size();
+            positions.emplace(cCode, i);
+            codes.emplace_back(cCode);
+        } else {
+            i = it->second;
+        }
+        if (!owner.empty() && owner.back() == i && found.back().offset + found.back().length == start) {
+            found.back().length = stop - found.back().offset;
+        } else {
+            RowRun run = { start, stop - start };
+            found.push_back(run);
+            owner.push_back(i);
+        }
+    }
+
+    runStart.assign(codes.size() + 1, 0);
+    for (size_t r = 0; r < owner.size(); r++)
+        runStart[owner[r] + 1]++;
+    for (size_t i = 0; i < codes.size(); i++)
+        runStart[i + 1] += runStart[i];
+    runs.resize(found.size());
+    std::vector<uint32_t> next(runStart.begin(), runStart.end() - 1);
+    for (size_t r = 0; r < found.size(); r++)
+        runs[next[owner[r]]++] = found[r];
+    sortCodes();
+}
+
+bool RowIndex::load(const std::string &csvFilename) {
+    int64_t stamp[3];
+    if (!sourceStamp(csvFilename, stamp))
+        return false;
+    MappedFile file;
+    if (!file.open(csvFilename + ".idx"))
+        return false;
+    SnapshotReader in(file.data(), file.size());
+    if (in.getString() != ROW_INDEX_TAG || in.getInt() != stamp[0] || in.getInt() != stamp[1] ||
+        in.getInt() != stamp[2])
+        return false;
+    int64_t numCodes = in.getInt();
+    if (!in.ok() || numCodes < 0 || numCodes > (1 << 30))
+        return false;
+    codes.clear();
+    runs.clear();
+    runStart.assign(1, 0);
+    sourceSize = (uint64_t)stamp[0];
+    for (int64_t i = 0; i < numCodes; i++) {
+        std::string_view code = in.getString();
+        int64_t numRuns = in.getInt();
+        if (!in.ok() || numRuns < 0 || numRuns > (1 << 30))
+            return false;
+        const RowRun *p = static_cast<const RowRun *>(in.getArray(numRuns * sizeof(RowRun)));
+        if (!in.ok())
+            return false;
+        for (int64_t r = 0; r < numRuns; r++) {
+            if (p[r].offset > sourceSize || p[r].length > sourceSize - p[r].offset)
+                return false;
+            runs.push_back(p[r]);
+        }
+        codes.emplace_back(code);
+        runStart.push_back((uint32_t)runs.size());
+    }
+    sortCodes();
+    return true;
+}
+
+bool RowIndex::save(const std::string &csvFilename) const {
+    int64_t stamp[3];
+    if (!sourceStamp(csvFilename, stamp) || (uint64_t)stamp[0] != sourceSize)
+        return false;
+    SnapshotWriter out;
+    out.putString(ROW_INDEX_TAG);
+    out.putInt(stamp[0]);
+    out.putInt(stamp[1]);
+    out.putInt(stamp[2]);
+    out.putInt((int64_t)codes.size());
+    for (size_t i = 0; i < codes.size(); i++) {
+        out.putString(codes[i]);
+        out.putInt(runStart[i + 1] - runStart[i]);
+        out.putArray(runs.data() + runStart[i], (runStart[i + 1] - runStart[i]) * sizeof(RowRun));
+    }
+    return out.writeTo(csvFilename + ".idx");
+}
+
+int RowIndex::find(std::string_view code) const {
+    auto it = std::lower_bound(byCode.begin(), byCode.end(), code,
+                               [this](uint32_t i, std::string_view c) { return codes[i] < c; });
+    if (it == byCode.end() || codes[*it] != code)
+        return -1;
+    return (int)*it;
+}
+
+const RowRun *RowIndex::runsOf(int i, int &numRuns) const {
+    numRuns = (int)(runStart[i + 1] - runStart[i]);
+    return runs.data() + runStart[i];
+}
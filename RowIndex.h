@@ -0,0 +1,46 @@
+#ifndef ROW_INDEX_H
+#define ROW_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A run of consecutive CSV lines that all belong to one country code.
+struct RowRun {
+    uint64_t offset;  // byte offset of the first line
+    uint64_t length;  // bytes up to and including the last line's newline
+};
+
+// RowIndex: where each country code's rows sit in a CSV file, as runs of consecutive lines.
+//
+// It is built in one pass over a mapped file, or read back from the sidecar file
+// "<csv>.idx" that save() writes next to the CSV. The sidecar records the CSV's size and
+// modification time, and only loads while the CSV still has both, so a stale index is
+// never used to seek into a file that has changed.
+class RowIndex {
+private:
+    std::vector<std::string> codes;  // in order of first appearance in the file
+    std::vector<uint32_t> runStart;  // runs of codes[i] are runs[runStart[i], runStart[i + 1])
+    std::vector<RowRun> runs;
+    std::vector<uint32_t> byCode;    // code positions sorted by code, for find()
+    uint64_t sourceSize;
+
+    void sortCodes();
+
+public:
+    RowIndex();
+
+    void build(const char *data, size_t size);
+    bool load(const std::string &csvFilename);
+    bool save(const std::string &csvFilename) const;
+
+    int numCodes() const { return (int)codes.size(); }
+    const std::string &code(int i) const { return codes[i]; }
+    // Position of a code, or -1 if the file has no rows for it.
+    int find(std::string_view code) const;
+    const RowRun *runsOf(int i, int &numRuns) const;
+};
+
+#endif
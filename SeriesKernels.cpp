@@ -0,0 +1,162 @@
+#include "SeriesKernels.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SERIES_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace SeriesKernels {
+
+static inline bool bitSet(const uint64_t *validity, size_t i) {
+    return (validity[i >> 6] >> (i & 63)) & 1;
+}
+
+// Four validity bits starting at i (i must be a multiple of 4, so they never straddle a word).
+static inline unsigned nibble(const uint64_t *validity, size_t i) {
+    return (unsigned)(validity[i >> 6] >> (i & 63)) & 0xF;
+}
+
+int countValid(const uint64_t *validity, size_t begin, size_t n) {
+    int count = 0;
+    size_t i = begin;
+    size_t end = begin + n;
+    while (i < end && (i & 63) != 0) {
+        count += bitSet(validity, i);
+        i++;
+    }
+    while (i + 64 <= end) {
+        count += __builtin_popcountll(validity[i >> 6]);
+        i += 64;
+    }
+    if (i < end)
+        count += __builtin_popcountll(validity[i >> 6] & ((1ULL << (end - i)) - 1));
+    return count;
+}
+
+// Every kernel adds the valid values one at a time in index order, starting from 0.0,
+// exactly as a plain loop does; the vector kernels only pick the values without branching.
+// A masked-out value is added as +0.0, which leaves the sum unchanged (the sum starts at
+// +0.0, so it is never -0.0). Values before the first 4-aligned index and after the last
+// full group of 4 go through the plain loop.
+struct Span {
+    size_t head;  // first 4-aligned index
+    size_t tail;  // end of the last full group of 4
+};
+
+static inline Span alignedSpan(size_t begin, size_t n) {
+    size_t end = begin + n;
+    size_t head = (begin + 3) & ~(size_t)3;
+    if (head > end)
+        head = end;
+    size_t tail = head + ((end - head) & ~(size_t)3);
+    Span span = { head, tail };
+    return span;
+}
+
+static inline double addValid(double sum, const double *values, const uint64_t *validity,
+                              size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+        if (bitSet(validity, i))
+            sum += values[i];
+    return sum;
+}
+
+static SumCount scalarSum(const double *values, const uint64_t *validity, size_t begin, size_t n) {
+    SumCount r;
+    r.sum = addValid(0.0, values, validity, begin, begin + n);
+    r.count = countValid(validity, begin, n);
+    return r;
+}
+
+#ifdef SERIES_KERNELS_X86
+static SumCount sse2Sum(const double *values, const uint64_t *validity, size_t begin, size_t n) {
+    Span span = alignedSpan(begin, n);
+    const __m128i bitLo = _mm_set_epi64x(2, 1);
+    const __m128i bitHi = _mm_set_epi64x(8, 4);
+    double sum = addValid(0.0, values, validity, begin, span.head);
+    double lane[4];
+    for (size_t i = span.head; i < span.tail; i += 4) {
+        __m128i bits = _mm_set1_epi64x(nibble(validity, i));
+        // SSE2 has no 64-bit compare; a 32-bit compare on values that are 0 or the bit works
+        // because the high halves are always zero.
+        __m128i lo = _mm_cmpeq_epi32(_mm_and_si128(bits, bitLo), bitLo);
+        __m128i hi = _mm_cmpeq_epi32(_mm_and_si128(bits, bitHi), bitHi);
+        lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 2, 0, 0));
+        hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 2, 0, 0));
+        _mm_storeu_pd(lane, _mm_and_pd(_mm_loadu_pd(values + i), _mm_castsi128_pd(lo)));
+        _mm_storeu_pd(lane + 2, _mm_and_pd(_mm_loadu_pd(values + i + 2), _mm_castsi128_pd(hi)));
+        sum += lane[0];
+        sum += lane[1];
+        sum += lane[2];
+        sum += lane[3];
+    }
+    SumCount r;
+    r.sum = addValid(sum, values, validity, span.tail, begin + n);
+    r.count = countValid(validity, begin, n);
+    return r;
+}
+
+__attribute__((target("avx2")))
+static SumCount avx2Sum(const double *values, const uint64_t *validity, size_t begin, size_t n) {
+    Span span = alignedSpan(begin, n);
+    const __m256i bit = _mm256_set_epi64x(8, 4, 2, 1);
+    double sum = addValid(0.0, values, validity, begin, span.head);
+    double lane[4];
+    for (size_t i = span.head; i < span.tail; i += 4) {
+        __m256i bits = _mm256_set1_epi64x(nibble(validity, i));
+        __m256i mask = _mm256_cmpeq_epi64(_mm256_and_si256(bits, bit), bit);
+        _mm256_storeu_pd(lane, _mm256_and_pd(_mm256_loadu_pd(values + i), _mm256_castsi256_pd(mask)));
+        sum += lane[0];
+        sum += lane[1];
+        sum += lane[2];
+        sum += lane[3];
+    }
+    SumCount r;
+    r.sum = addValid(sum, values, validity, span.tail, begin + n);
+    r.count = countValid(validity, begin, n);
+    return r;
+}
+#endif
+
+typedef SumCount (*SumKernel)(const double *, const uint64_t *, size_t, size_t);
+
+struct Dispatch {
+    SumKernel sum;
+    const char *name;
+};
+
+// SERIES_KERNEL=scalar|sse2|avx2 caps the choice, e.g. to compare kernels on one machine.
+static Dispatch pickKernel() {
+    Dispatch d = { scalarSum, "scalar" };
+#ifdef SERIES_KERNELS_X86
+    const char *cap = getenv("SERIES_KERNEL");
+    bool allowAvx2 = (cap == nullptr || strcmp(cap, "avx2") == 0);
+    bool allowSse2 = allowAvx2 || strcmp(cap, "sse2") == 0;
+    __builtin_cpu_init();
+    if (allowAvx2 && __builtin_cpu_supports("avx2")) {
+        d.sum = avx2Sum;
+        d.name = "avx2";
+    } else if (allowSse2 && __builtin_cpu_supports("sse2")) {
+        d.sum = sse2Sum;
+        d.name = "sse2";
+    }
+#endif
+    return d;
+}
+
+static const Dispatch &kernel() {
+    static const Dispatch d = pickKernel();
+    return d;
+}
+
+SumCount maskedSum(const double *values, const uint64_t *validity, size_t begin, size_t n) {
+    return kernel().sum(values, validity, begin, n);
+}
+
+const char *kernelName() {
+    return kernel().name;
+}
+
+} // namespace SeriesKernels
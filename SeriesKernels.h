@@ -0,0 +1,32 @@
+#ifndef SERIES_KERNELS_H
+#define SERIES_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Aggregation kernels over a value buffer plus its validity bitmap
+// (bit i of the bitmap set = values[i] holds real data).
+//
+// The best implementation for the running CPU (AVX2, SSE2 or scalar) is picked once, at
+// first use; the SERIES_KERNEL environment variable can force a slower one. Every variant
+// adds the valid values in index order, so they all return the same sum, bit for bit, as
+// a plain loop over the slice.
+namespace SeriesKernels {
+
+struct SumCount {
+    double sum;    // sum of the valid values
+    int count;     // number of valid values
+};
+
+// Sum and count the valid values among values[begin, begin + n).
+SumCount maskedSum(const double *values, const uint64_t *validity, size_t begin, size_t n);
+
+// Number of set bits in validity[begin, begin + n).
+int countValid(const uint64_t *validity, size_t begin, size_t n);
+
+// Name of the kernel maskedSum dispatches to ("avx2", "sse2" or "scalar").
+const char *kernelName();
+
+} // namespace SeriesKernels
+
+#endif
@@ -0,0 +1,150 @@
+#include "Snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char SNAPSHOT_MAGIC[8] = { 'C', 'D', 'S', 'N', 'A', 'P', 'S', 'H' };
+
+static inline size_t padded(size_t bytes) {
+    return (bytes + 7) & ~(size_t)7;
+}
+
+uint64_t snapshotChecksum(const char *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+        h ^= h >> 32;
+    }
+    for (; i < size; i++)
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// SNAPSHOTWRITER IMPLEMENTATION
+void SnapshotWriter::pad() {
+    payload.append(padded(payload.size()) - payload.size(), '\0');
+}
+
+void SnapshotWriter::putInt(int64_t value) {
+    payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void SnapshotWriter::putDouble(double value) {
+    payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void SnapshotWriter::putString(std::string_view s) {
+    putInt((int64_t)s.size());
+    payload.append(s.data(), s.size());
+    pad();
+}
+
+void SnapshotWriter::putArray(const void *data, size_t bytes) {
+    if (bytes > 0)
+        payload.append(static_cast<const char *>(data), bytes);
+    pad();
+}
+
+static bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool SnapshotWriter::writeTo(const std::string &filename) const {
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.payloadSize = payload.size();
+    header.checksum = snapshotChecksum(payload.data(), payload.size());
+
+    // Each writer gets its own temporary file next to the target, so two SAVEs of the same
+    // file (e.g. from two reader threads of a CountryDataServer) never write into one file;
+    // the last rename wins with a complete snapshot.
+    std::string temp = filename + ".XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd == -1)
+        return false;
+    bool ok = fchmod(fd, 0644) == 0 &&
+              writeAll(fd, reinterpret_cast<const char *>(&header), sizeof(header)) &&
+              writeAll(fd, payload.data(), payload.size());
+    if (::close(fd) != 0)
+        ok = false;
+    if (ok && rename(temp.c_str(), filename.c_str()) != 0)
+        ok = false;
+    if (!ok)
+        unlink(temp.c_str());
+    return ok;
+}
+
+// SNAPSHOTREADER IMPLEMENTATION
+SnapshotReader::SnapshotReader(const char *data, size_t size)
+    : pos(nullptr), end(nullptr), good(false)
+{
+    SnapshotHeader header;
+    if (data == nullptr || size < sizeof(header))
+        return;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER ||
+        header.payloadSize != size - sizeof(header))
+        return;
+    pos = data + sizeof(header);
+    end = data + size;
+    good = (snapshotChecksum(pos, end - pos) == header.checksum);
+}
+
+// Step over 'bytes' bytes plus padding; nullptr (and ok() false) if they are not there.
+const char *SnapshotReader::take(size_t bytes) {
+    if (!good || padded(bytes) > (size_t)(end - pos)) {
+        good = false;
+        return nullptr;
+    }
+    const char *p = pos;
+    pos += padded(bytes);
+    return p;
+}
+
+int64_t SnapshotReader::getInt() {
+    int64_t value = 0;
+    const char *p = take(sizeof(value));
+    if (p != nullptr)
+        memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+double SnapshotReader::getDouble() {
+    double value = 0.0;
+    const char *p = take(sizeof(value));
+    if (p != nullptr)
+        memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+std::string_view SnapshotReader::getString() {
+    int64_t length = getInt();
+    if (length < 0) {
+        good = false;
+        return std::string_view();
+    }
+    const char *p = take((size_t)length);
+    if (p == nullptr)
+        return std::string_view();
+    return std::string_view(p, (size_t)length);
+}
+
+const void *SnapshotReader::getArray(size_t bytes) {
+    return take(bytes);
+}
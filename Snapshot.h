@@ -0,0 +1,70 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// Binary snapshot files written by SAVE and read back by OPEN.
+//
+// A snapshot is a fixed header followed by the payload. Every item in the payload is
+// padded to a multiple of 8 bytes, so arrays can be used in place from a mapping of the
+// file. Numbers are stored in the writer's native byte order; the header records it, so
+// a snapshot from a machine with the other byte order is rejected rather than misread.
+static const uint32_t SNAPSHOT_VERSION = 4;
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];         // "CDSNAPSH"
+    uint32_t version;      // SNAPSHOT_VERSION
+    uint32_t byteOrder;    // SNAPSHOT_BYTE_ORDER, as the writer saw it
+    uint64_t payloadSize;  // bytes after the header
+    uint64_t checksum;     // snapshotChecksum of the payload
+};
+
+// 64-bit checksum of a buffer, consumed a word at a time.
+uint64_t snapshotChecksum(const char *data, size_t size);
+
+// SnapshotWriter: collects the payload in memory, then writes header and payload out.
+class SnapshotWriter {
+private:
+    std::string payload;
+
+    void pad();
+
+public:
+    void putInt(int64_t value);
+    void putDouble(double value);
+    void putString(std::string_view s);
+    void putArray(const void *data, size_t bytes);
+
+    // Write the snapshot to a temporary file of its own and rename it over 'filename', so a
+    // failed or concurrent SAVE never leaves a half-written or mixed snapshot behind.
+    bool writeTo(const std::string &filename) const;
+};
+
+// SnapshotReader: walks the payload of a snapshot held in memory (normally a mapping).
+// Strings and arrays come back as pointers into that memory. Any read past the end
+// clears ok() and returns zeros from then on.
+class SnapshotReader {
+private:
+    const char *pos;
+    const char *end;
+    bool good;
+
+    const char *take(size_t bytes);
+
+public:
+    // Checks the header (magic, version, byte order, size and checksum) of the
+    // 'size' bytes at 'data'. ok() is false if any of them is wrong.
+    SnapshotReader(const char *data, size_t size);
+
+    bool ok() const { return good; }
+    int64_t getInt();
+    double getDouble();
+    std::string_view getString();
+    const void *getArray(size_t bytes);
+};
+
+#endif
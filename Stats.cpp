@@ -0,0 +1,84 @@
+#include "Stats.h"
+
+#ifdef COUNTRYDATA_STATS
+#include <algorithm>
+#include <cstdio>
+
+static const char *const COMMAND_NAMES[STAT_COMMANDS] = {
+    "LOAD", "BUILD", "RANGE", "LIST", "FIND", "DELETE", "LIMITS",
+    "INSERT", "LOOKUP", "REMOVE", "SAVE", "OPEN", "APPEND", "INDEX",
+    "TOPK", "PERCENTILE"
+};
+
+// Raise 'target' to at least 'value'.
+static void storeMax(std::atomic<uint64_t> &target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+// LATENCYHISTOGRAM IMPLEMENTATION
+LatencyHistogram::LatencyHistogram() : calls(0), totalNanos(0), maxNanos(0) {
+    for (int b = 0; b < BUCKETS; b++)
+        buckets[b].store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    int b = (nanos == 0) ? 0 : 64 - __builtin_clzll(nanos);
+    if (b >= BUCKETS)
+        b = BUCKETS - 1;
+    buckets[b].fetch_add(1, std::memory_order_relaxed);
+    calls.fetch_add(1, std::memory_order_relaxed);
+    totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    storeMax(maxNanos, nanos);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    uint64_t n = calls.load(std::memory_order_relaxed);
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += buckets[b].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min<uint64_t>(1ULL << b, maxNanos.load(std::memory_order_relaxed));
+    }
+    return maxNanos.load(std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::format(const char *name) const {
+    uint64_t n = calls.load(std::memory_order_relaxed);
+    double total = (double)totalNanos.load(std::memory_order_relaxed);
+    char line[256];
+    snprintf(line, sizeof(line), "%s calls %llu mean_us %.3f p50_us %.3f p90_us %.3f p99_us %.3f max_us %.3f",
+             name, (unsigned long long)n, (n > 0) ? total / n / 1000.0 : 0.0,
+             (n > 0) ? percentile(50) / 1000.0 : 0.0, (n > 0) ? percentile(90) / 1000.0 : 0.0,
+             (n > 0) ? percentile(99) / 1000.0 : 0.0, maxNanos.load(std::memory_order_relaxed) / 1000.0);
+    return line;
+}
+
+// PROBECOUNTER IMPLEMENTATION
+ProbeCounter::ProbeCounter() : calls(0), probes(0), maxProbes(0) {
+}
+
+void ProbeCounter::record(int n) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    probes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+    storeMax(maxProbes, (uint64_t)n);
+}
+
+std::string ProbeCounter::format(const char *name) const {
+    uint64_t n = calls.load(std::memory_order_relaxed);
+    char line[160];
+    snprintf(line, sizeof(line), "%s calls %llu avg_probes %.3f max_probes %llu", name, (unsigned long long)n,
+             (n > 0) ? (double)probes.load(std::memory_order_relaxed) / n : 0.0,
+             (unsigned long long)maxProbes.load(std::memory_order_relaxed));
+    return line;
+}
+
+const char *statsCommandName(int command) {
+    return COMMAND_NAMES[command];
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Instrumentation behind the STATS command. It only exists when the program is built with
+// -DCOUNTRYDATA_STATS (make DEFINES=-DCOUNTRYDATA_STATS); otherwise the STATS_* macros
+// expand to nothing and STATS reports failure.
+#ifdef COUNTRYDATA_STATS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum StatsCommand {
+    STAT_LOAD, STAT_BUILD, STAT_RANGE, STAT_LIST, STAT_FIND, STAT_DELETE, STAT_LIMITS,
+    STAT_INSERT, STAT_LOOKUP, STAT_REMOVE, STAT_SAVE, STAT_OPEN, STAT_APPEND, STAT_INDEX,
+    STAT_TOPK, STAT_PERCENTILE,
+    STAT_COMMANDS  // number of commands
+};
+
+// Call count and a log2 histogram of latencies: bucket b counts calls that took
+// [2^(b-1), 2^b) nanoseconds (bucket 0: under 1ns). All counters are relaxed atomics;
+// they are only ever summed, never used to order anything.
+struct LatencyHistogram {
+    static const int BUCKETS = 48;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> totalNanos;
+    std::atomic<uint64_t> maxNanos;
+    std::atomic<uint64_t> buckets[BUCKETS];
+
+    LatencyHistogram();
+    void record(uint64_t nanos);
+    // Upper bound (in ns) of the bucket holding the p-th percentile call, capped at the max.
+    uint64_t percentile(double p) const;
+    std::string format(const char *name) const;
+};
+
+// Probe lengths of one hash-table operation.
+struct ProbeCounter {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> probes;
+    std::atomic<uint64_t> maxProbes;
+
+    ProbeCounter();
+    void record(int n);
+    std::string format(const char *name) const;
+};
+
+struct CommandStats {
+    LatencyHistogram commands[STAT_COMMANDS];
+    ProbeCounter search;
+    ProbeCounter insert;
+    ProbeCounter remove;
+};
+
+const char *statsCommandName(int command);
+
+// Records the lifetime of a command call into its histogram.
+class StatsTimer {
+private:
+    LatencyHistogram &histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StatsTimer(LatencyHistogram &h) : histogram(h), start(std::chrono::steady_clock::now()) {}
+    ~StatsTimer() {
+        histogram.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+#define STATS_TIME(command) StatsTimer statsTimer(stats.commands[command])
+#define STATS_PROBES(counter, n) stats.counter.record(n)
+
+#else
+
+#define STATS_TIME(command)
+#define STATS_PROBES(counter, n)
+
+#endif
+
+#endif
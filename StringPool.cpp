@@ -0,0 +1,84 @@
+#include "StringPool.h"
+#include "Arena.h"
+#include <cstring>
+#include <functional>
+
+static const uint32_t INITIAL_POOL_SLOTS = 1024;
+
+// STRINGPOOL IMPLEMENTATION
+StringPool::StringPool(Arena &a)
+    : arena(a), strings(nullptr), count(0), capacity(0), slots(nullptr), numSlots(0)
+{
+}
+
+StringPool::~StringPool() {
+    delete[] strings;
+    delete[] slots;
+}
+
+uint32_t StringPool::hashOf(std::string_view s) {
+    return (uint32_t)std::hash<std::string_view>()(s);
+}
+
+// Double the id array and the lookup table together, keeping the table at most half full.
+void StringPool::grow() {
+    uint32_t newCapacity = (capacity == 0) ? INITIAL_POOL_SLOTS / 2 : capacity * 2;
+    std::string_view *newStrings = new std::string_view[newCapacity];
+    for (uint32_t i = 0; i < count; i++)
+        newStrings[i] = strings[i];
+    delete[] strings;
+    strings = newStrings;
+    capacity = newCapacity;
+
+    numSlots = newCapacity * 2;
+    delete[] slots;
+    slots = new uint32_t[numSlots];
+    memset(slots, 0, numSlots * sizeof(uint32_t));
+    uint32_t mask = numSlots - 1;
+    for (uint32_t id = 0; id < count; id++) {
+        uint32_t pos = hashOf(strings[id]) & mask;
+        while (slots[pos] != 0)
+            pos = (pos + 1) & mask;
+        slots[pos] = id + 1;
+    }
+}
+
+uint32_t StringPool::intern(std::string_view s) {
+    if (count >= capacity)
+        grow();
+    uint32_t mask = numSlots - 1;
+    uint32_t pos = hashOf(s) & mask;
+    while (slots[pos] != 0) {
+        if (strings[slots[pos] - 1] == s)
+            return slots[pos] - 1;
+        pos = (pos + 1) & mask;
+    }
+    uint32_t id = count++;
+    strings[id] = arena.copy(s);
+    slots[pos] = id + 1;
+    return id;
+}
+
+uint32_t StringPool::find(std::string_view s) const {
+    if (count == 0)
+        return NO_STRING;
+    uint32_t mask = numSlots - 1;
+    uint32_t pos = hashOf(s) & mask;
+    while (slots[pos] != 0) {
+        if (strings[slots[pos] - 1] == s)
+            return slots[pos] - 1;
+        pos = (pos + 1) & mask;
+    }
+    return NO_STRING;
+}
+
+// Keep the arrays for the next fill; only the ids go.
+void StringPool::clear() {
+    count = 0;
+    if (slots != nullptr)
+        memset(slots, 0, numSlots * sizeof(uint32_t));
+}
+
+size_t StringPool::bytes() const {
+    return (size_t)capacity * sizeof(std::string_view) + (size_t)numSlots * sizeof(uint32_t);
+}
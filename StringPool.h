@@ -0,0 +1,49 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+class Arena;
+
+// StringPool: one copy of each distinct string, named by a dense integer id (0, 1, 2, ...
+// in order of first intern). Equal strings always get the same id, so comparing ids is
+// comparing strings.
+//
+// The characters live in the Arena passed to the constructor; clear() forgets the ids
+// and must go with a reset() of that arena. Ids are found through an open-addressed table
+// (linear probing) of id + 1, 0 meaning empty.
+class StringPool {
+private:
+    Arena &arena;
+    std::string_view *strings;  // by id
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t numSlots;          // power of two
+
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    static uint32_t hashOf(std::string_view s);
+    void grow();
+
+public:
+    static const uint32_t NO_STRING = 0xffffffffu;
+
+    explicit StringPool(Arena &arena);
+    ~StringPool();
+
+    // The id of s, adding a copy of it if it is new.
+    uint32_t intern(std::string_view s);
+    // The id of s, or NO_STRING if it was never interned.
+    uint32_t find(std::string_view s) const;
+    std::string_view get(uint32_t id) const { return strings[id]; }
+    uint32_t size() const { return count; }
+    void clear();
+    // Bytes of the id and lookup arrays (the characters are counted with the arena).
+    size_t bytes() const;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "WindowIndex.h"
+#include <cstring>
+#include <limits>
+
+static const double WINDOW_INFINITY = std::numeric_limits<double>::infinity();
+
+// Grow one array to 'newCapacity' entries, keeping the first 'used'.
+template <class T>
+static void regrow(T *&array, int used, int newCapacity) {
+    T *grown = new T[newCapacity];
+    if (array != nullptr && used > 0)
+        memcpy(grown, array, used * sizeof(T));
+    delete[] array;
+    array = grown;
+}
+
+WindowIndex::WindowIndex()
+    : prefixSum(nullptr), prefixSquares(nullptr), prefixCount(nullptr), levels(0), capacity(0),
+      runningSum(0.0), runningSquares(0.0), runningCount(0)
+{
+    for (int k = 0; k < MAX_LEVELS; k++) {
+        minLevel[k] = nullptr;
+        maxLevel[k] = nullptr;
+    }
+}
+
+WindowIndex::~WindowIndex() {
+    clear();
+}
+
+void WindowIndex::clear() {
+    delete[] prefixSum;
+    delete[] prefixSquares;
+    delete[] prefixCount;
+    prefixSum = nullptr;
+    prefixSquares = nullptr;
+    prefixCount = nullptr;
+    for (int k = 0; k < levels; k++) {
+        delete[] minLevel[k];
+        delete[] maxLevel[k];
+        minLevel[k] = nullptr;
+        maxLevel[k] = nullptr;
+    }
+    levels = 0;
+    capacity = 0;
+}
+
+void WindowIndex::reserve(int newCapacity) {
+    if (newCapacity <= capacity)
+        return;
+    regrow(prefixSum, capacity, newCapacity);
+    regrow(prefixSquares, capacity, newCapacity);
+    regrow(prefixCount, capacity, newCapacity);
+    for (int k = 0; k < levels; k++) {
+        regrow(minLevel[k], capacity, newCapacity);
+        regrow(maxLevel[k], capacity, newCapacity);
+    }
+    capacity = newCapacity;
+}
+
+// Sparse-table levels are only allocated once a slice is long enough to use them.
+void WindowIndex::addLevel() {
+    minLevel[levels] = new double[capacity];
+    maxLevel[levels] = new double[capacity];
+    levels++;
+}
+
+void WindowIndex::indexSlice(const double *values, const uint64_t *validity, int offset, int n) {
+    beginSlice(n);
+    for (int pos = offset; pos < offset + n; pos++)
+        addValue(pos, values[pos], (validity[pos >> 6] >> (pos & 63)) & 1);
+    finishSlice(offset, n);
+}
+
+void WindowIndex::beginSlice(int n) {
+    runningSum = 0.0;
+    runningSquares = 0.0;
+    runningCount = 0;
+    if (levels == 0 && n > 0)
+        addLevel();
+}
+
+void WindowIndex::addValue(int pos, double value, bool valid) {
+    if (valid) {
+        runningSum += value;
+        runningSquares += value * value;
+        runningCount++;
+    }
+    prefixSum[pos] = runningSum;
+    prefixSquares[pos] = runningSquares;
+    prefixCount[pos] = runningCount;
+    minLevel[0][pos] = valid ? value : WINDOW_INFINITY;
+    maxLevel[0][pos] = valid ? value : -WINDOW_INFINITY;
+}
+
+// Levels 1 and up, from level 0 of the slice.
+void WindowIndex::finishSlice(int offset, int n) {
+    for (int k = 1; (1 << k) <= n; k++) {
+        if (k == levels)
+            addLevel();
+        int half = 1 << (k - 1);
+        for (int i = offset; i + (1 << k) <= offset + n; i++) {
+            double a = minLevel[k - 1][i], b = minLevel[k - 1][i + half];
+            minLevel[k][i] = (a < b) ? a : b;
+            a = maxLevel[k - 1][i];
+            b = maxLevel[k - 1][i + half];
+            maxLevel[k][i] = (a > b) ? a : b;
+        }
+    }
+}
+
+WindowStats WindowIndex::query(int offset, int first, int last) const {
+    WindowStats w;
+    int to = offset + last;
+    int before = offset + first - 1;
+    w.sum = prefixSum[to];
+    w.squares = prefixSquares[to];
+    w.count = prefixCount[to];
+    if (first > 0) {
+        w.sum -= prefixSum[before];
+        w.squares -= prefixSquares[before];
+        w.count -= prefixCount[before];
+    }
+    // Two blocks of 2^k values, one from each end, cover the window.
+    int k = 31 - __builtin_clz((unsigned)(last - first + 1));
+    int a = offset + first;
+    int b = to - (1 << k) + 1;
+    w.min = (minLevel[k][a] < minLevel[k][b]) ? minLevel[k][a] : minLevel[k][b];
+    w.max = (maxLevel[k][a] > maxLevel[k][b]) ? maxLevel[k][a] : maxLevel[k][b];
+    return w;
+}
+
+size_t WindowIndex::bytes() const {
+    return (size_t)capacity * (2 * sizeof(double) + sizeof(int) + levels * 2 * sizeof(double));
+}
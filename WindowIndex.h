@@ -0,0 +1,65 @@
+#ifndef WINDOW_INDEX_H
+#define WINDOW_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Aggregates of the valid values in one window of a slice.
+struct WindowStats {
+    double sum;
+    double squares;  // sum of the squared valid values
+    int count;       // number of valid values
+    double min;      // +infinity if count is 0
+    double max;      // -infinity if count is 0
+};
+
+// WindowIndex: answers sum, count, sum of squares, min and max over any window of a
+// slice of a value buffer in O(1).
+//
+// It runs alongside a Column's buffer and is filled slice by slice: the prefix arrays
+// restart at each slice's first value, and level k of the sparse table holds the min and
+// max of the 2^k values starting at each position, for the positions where those values
+// all lie in the slice. A window is then two prefix differences and two overlapping
+// sparse-table lookups.
+class WindowIndex {
+private:
+    static const int MAX_LEVELS = 31;
+
+    double *prefixSum;      // prefixSum[offset + i] = sum of the slice's valid values [0, i]
+    double *prefixSquares;
+    int *prefixCount;
+    double *minLevel[MAX_LEVELS];  // level 0 is the values themselves (+inf where missing)
+    double *maxLevel[MAX_LEVELS];  // (-inf where missing)
+    int levels;             // levels allocated
+    int capacity;
+
+    WindowIndex(const WindowIndex &) = delete;
+    WindowIndex &operator=(const WindowIndex &) = delete;
+
+    double runningSum;      // state of the slice being indexed by addValue
+    double runningSquares;
+    int runningCount;
+
+    void addLevel();
+
+public:
+    WindowIndex();
+    ~WindowIndex();
+
+    // Make room for a buffer of 'newCapacity' values, keeping what is indexed.
+    void reserve(int newCapacity);
+    void clear();
+    // Index the slice values[offset, offset + n).
+    void indexSlice(const double *values, const uint64_t *validity, int offset, int n);
+    // The same in steps, for values that are not in one buffer: beginSlice, then addValue
+    // for positions offset .. offset + n - 1 in order, then finishSlice.
+    void beginSlice(int n);
+    void addValue(int pos, double value, bool valid);
+    void finishSlice(int offset, int n);
+    // Aggregates over positions [first, last] (inclusive, 0 <= first <= last < n) of the
+    // slice starting at 'offset', which must have been indexed since it last changed.
+    WindowStats query(int offset, int first, int last) const;
+    size_t bytes() const;
+};
+
+#endif
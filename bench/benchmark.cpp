@@ -0,0 +1,238 @@
+// benchmark: times each CountryData command on a dataset and reports throughput and
+// latency percentiles per command.
+//
+// usage: benchmark data.csv [-r load rounds] [-q queries] [-i inserts] [-j load and build threads] [-s seed]
+//
+// -i also sets the number of rows in each APPEND delta.
+#include "../CountryData.h"
+#include "../CsvReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Latencies of one command, in microseconds.
+struct Samples {
+    const char *name;
+    std::vector<double> micros;
+};
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0.0;
+    size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static void report(Samples &s) {
+    if (s.micros.empty())
+        return;
+    std::sort(s.micros.begin(), s.micros.end());
+    double total = 0.0;
+    for (size_t i = 0; i < s.micros.size(); i++)
+        total += s.micros[i];
+    printf("%-10s %8zu %11.2f %12.0f %10.2f %10.2f %10.2f %10.2f\n", s.name, s.micros.size(),
+           total / 1000.0, s.micros.size() / (total / 1e6), percentile(s.micros, 50),
+           percentile(s.micros, 90), percentile(s.micros, 99), s.micros.back());
+}
+
+// Keeps the optimizer from dropping calls whose results are otherwise unused.
+static size_t sink = 0;
+
+template <class F>
+static void timeOne(Samples &s, F f) {
+    Clock::time_point start = Clock::now();
+    f();
+    Clock::time_point stop = Clock::now();
+    s.micros.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s data.csv [-r rounds] [-q queries] [-i inserts] [-j threads] [-s seed]\n", argv[0]);
+        return 1;
+    }
+    std::string filename = argv[1];
+    int rounds = 5;
+    int queries = 100000;
+    int inserts = 200;
+    int threads = 1;
+    unsigned long seed = 1;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0)
+            rounds = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-q") == 0)
+            queries = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-i") == 0)
+            inserts = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-j") == 0)
+            threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    // Collect the country codes, names and series codes the queries draw from.
+    std::vector<std::string> codes, names, seriesCodes;
+    {
+        MappedFile file;
+        if (!file.open(filename)) {
+            fprintf(stderr, "cannot open %s\n", filename.c_str());
+            return 1;
+        }
+        CsvCursor cursor(file.data(), file.data() + file.size());
+        std::string_view line, cName, cCode, sName, sCode;
+        while (cursor.nextLine(line)) {
+            CsvCursor::nextField(line, cName);
+            CsvCursor::nextField(line, cCode);
+            CsvCursor::nextField(line, sName);
+            CsvCursor::nextField(line, sCode);
+            if (codes.empty() || codes.back() != cCode) {
+                codes.emplace_back(cCode);
+                names.emplace_back(cName);
+            }
+            seriesCodes.emplace_back(sCode);
+        }
+        std::sort(seriesCodes.begin(), seriesCodes.end());
+        seriesCodes.erase(std::unique(seriesCodes.begin(), seriesCodes.end()), seriesCodes.end());
+    }
+    if (codes.empty() || seriesCodes.empty()) {
+        fprintf(stderr, "%s has no rows\n", filename.c_str());
+        return 1;
+    }
+    printf("%s: %zu countries, %zu series codes\n\n", filename.c_str(), codes.size(), seriesCodes.size());
+
+    std::mt19937_64 rng(seed);
+    CountryData data;
+    data.setLoadThreads(threads);
+    data.setBuildThreads(threads);
+    Samples load = { "LOAD", {} }, build = { "BUILD", {} }, buildHit = { "BUILD-hit", {} };
+    Samples buildWindow = { "BUILD-win", {} };
+    Samples loadLazy = { "LOAD-lazy", {} }, buildLazy = { "BUILD-lazy", {} };
+    Samples range = { "RANGE", {} }, find = { "FIND", {} }, limits = { "LIMITS", {} };
+    Samples topk = { "TOPK", {} }, percentile = { "PERCENTILE", {} };
+    Samples lookup = { "LOOKUP", {} }, list = { "LIST", {} };
+    Samples remove = { "REMOVE", {} }, insert = { "INSERT", {} }, append = { "APPEND", {} };
+    Samples insertBatch = { "INSERT-all", {} }, insertIndexed = { "INSERT-idx", {} };
+    Samples save = { "SAVE", {} }, open = { "OPEN", {} };
+
+    for (int r = 0; r < rounds; r++)
+        timeOne(load, [&] { sink += data.load(filename); });
+
+    // Cycle through more codes than the build cache holds, so most BUILDs are real
+    // builds; then go back to the most recent few, which the cache serves.
+    size_t numBuilds = std::min<size_t>(seriesCodes.size(), 4 * BUILD_CACHE_SIZE);
+    for (size_t i = 0; i < numBuilds; i++)
+        timeOne(build, [&] { sink += data.buildCommand(seriesCodes[i]); });
+    for (size_t i = numBuilds - std::min<size_t>(numBuilds, BUILD_CACHE_SIZE); i < numBuilds; i++)
+        timeOne(buildHit, [&] { sink += data.buildCommand(seriesCodes[i]); });
+    // Windowed builds of every aggregate kind; the first one of a code indexes its column.
+    for (size_t i = 0; i < numBuilds; i++) {
+        AggregateKind kind = (AggregateKind)(i % (AGG_STDDEV + 1));
+        timeOne(buildWindow, [&] { sink += data.buildCommand(seriesCodes[i], 1990, 2010, kind); });
+    }
+
+    // Lazy LOAD of the same file; the first BUILD of each code then parses its column.
+    {
+        CountryData lazy;
+        lazy.setLoadThreads(threads);
+        lazy.setBuildThreads(threads);
+        lazy.setLazyLoad(true);
+        for (int r = 0; r < rounds; r++)
+            timeOne(loadLazy, [&] { sink += lazy.load(filename); });
+        for (size_t i = 0; i < numBuilds; i++)
+            timeOne(buildLazy, [&] { sink += lazy.buildCommand(seriesCodes[i]); });
+    }
+
+    static const char *ops[] = { "less", "greater", "equal" };
+    static const char *conditions[] = { "lowest", "highest" };
+    std::uniform_real_distribution<double> threshold(0.0, 1000.0);
+    std::uniform_int_distribution<size_t> pickCountry(0, codes.size() - 1);
+    for (int q = 0; q < queries; q++) {
+        const char *op = ops[q % 3];
+        double mean = threshold(rng);
+        timeOne(find, [&] { sink += data.findCommand(mean, op).size(); });
+        if (q % 10 == 0) {
+            timeOne(range, [&] { sink += data.rangeCommand("").size(); });
+            timeOne(limits, [&] { sink += data.limitsCommand(conditions[q % 2]).size(); });
+            timeOne(topk, [&] { sink += data.topkCommand(10, conditions[q % 2]).size(); });
+            timeOne(percentile, [&] { sink += data.percentileCommand(mean / 10.0).size(); });
+        }
+        // One lookup in ten misses.
+        std::string code = (q % 10 == 9) ? std::string("ZZZ") : codes[pickCountry(rng)];
+        timeOne(lookup, [&] { sink += data.lookupCommand(code).second; });
+        const std::string &name = names[pickCountry(rng)];
+        timeOne(list, [&] { sink += data.listCommand(name).size(); });
+    }
+
+    // Take countries out and put them back: each INSERT scans the whole file.
+    std::vector<std::string> victims;
+    for (int i = 0; i < inserts && i < (int)codes.size(); i++)
+        victims.push_back(codes[pickCountry(rng)]);
+    for (size_t i = 0; i < victims.size(); i++)
+        timeOne(remove, [&] { sink += data.removeCommand(victims[i]); });
+    for (size_t i = 0; i < victims.size(); i++)
+        timeOne(insert, [&] { sink += data.insertCommand(victims[i], filename); });
+    // The same countries again, all in one pass over the file...
+    for (size_t i = 0; i < victims.size(); i++)
+        sink += data.removeCommand(victims[i]);
+    timeOne(insertBatch, [&] { sink += data.insertBatchCommand(victims, filename); });
+    // ...and one by one through a sidecar index.
+    if (data.indexCommand(filename)) {
+        for (size_t i = 0; i < victims.size(); i++)
+            sink += data.removeCommand(victims[i]);
+        for (size_t i = 0; i < victims.size(); i++)
+            timeOne(insertIndexed, [&] { sink += data.insertCommand(victims[i], filename); });
+        ::remove((filename + ".idx").c_str());
+    }
+
+    // Nightly-style deltas: random rows of the data, each one year longer per round, so
+    // APPEND both overwrites years it has and extends series, with builds to keep current.
+    std::string delta = filename + ".delta";
+    {
+        std::vector<std::string> lines;
+        MappedFile file;
+        file.open(filename);
+        CsvCursor cursor(file.data(), file.data() + file.size());
+        std::string_view line;
+        while (cursor.nextLine(line))
+            lines.emplace_back(line);
+        std::uniform_int_distribution<size_t> pickLine(0, lines.size() - 1);
+        for (int r = 0; r < rounds; r++) {
+            FILE *out = fopen(delta.c_str(), "w");
+            if (out == nullptr)
+                break;
+            for (int i = 0; i < inserts; i++) {
+                fputs(lines[pickLine(rng)].c_str(), out);
+                for (int y = 0; y <= r; y++)
+                    fprintf(out, ",%.3f", threshold(rng));
+                fputc('\n', out);
+            }
+            fclose(out);
+            timeOne(append, [&] { sink += data.appendCommand(delta); });
+        }
+        ::remove(delta.c_str());
+    }
+
+    std::string snapshot = filename + ".snap";
+    for (int r = 0; r < rounds; r++) {
+        timeOne(save, [&] { sink += data.saveCommand(snapshot); });
+        timeOne(open, [&] { sink += data.openCommand(snapshot); });
+    }
+    ::remove(snapshot.c_str());
+
+    printf("%-10s %8s %11s %12s %10s %10s %10s %10s\n", "command", "ops", "total ms", "ops/s",
+           "p50 us", "p90 us", "p99 us", "max us");
+    Samples *all[] = { &load, &build, &buildHit, &buildWindow, &loadLazy, &buildLazy, &range, &find, &limits,
+                       &topk, &percentile, &lookup, &list,
+                       &remove, &insert, &insertBatch, &insertIndexed, &append, &save, &open };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+        report(*all[i]);
+    printf("\n(checksum %zu)\n", sink);
+    return 0;
+}
@@ -0,0 +1,86 @@
+// gendata: writes a synthetic dataset in the CSV format LOAD and INSERT read:
+//     Country Name,CCC,Series Name,SERIES.CODE,v1960,v1961,...
+// one row per (country, series), with missing values written as -1.
+//
+// usage: gendata [-c countries] [-s series] [-y years] [-p coverage%] [-m missing%] [-r seed]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+    int countries = 2000;   // at most 26^3, one per three-letter code
+    int series = 200;
+    int years = 60;
+    int coverage = 90;      // percent of (country, series) pairs that get a row
+    int missing = 10;       // percent of values written as missing
+    unsigned long seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-c") == 0)
+            countries = value;
+        else if (strcmp(argv[i], "-s") == 0)
+            series = value;
+        else if (strcmp(argv[i], "-y") == 0)
+            years = value;
+        else if (strcmp(argv[i], "-p") == 0)
+            coverage = value;
+        else if (strcmp(argv[i], "-m") == 0)
+            missing = value;
+        else if (strcmp(argv[i], "-r") == 0)
+            seed = strtoul(argv[i + 1], nullptr, 10);
+        else {
+            fprintf(stderr, "usage: %s [-c countries] [-s series] [-y years] [-p coverage%%] [-m missing%%] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (countries > 26 * 26 * 26)
+        countries = 26 * 26 * 26;
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::uniform_real_distribution<double> base(0.0, 1000.0);
+    std::normal_distribution<double> drift(0.0, 0.02);
+
+    // Draw distinct codes at random from the whole key space (a partial shuffle), so the
+    // table sees realistic collisions rather than a dense run from AAA.
+    std::vector<int> keys(26 * 26 * 26);
+    for (size_t k = 0; k < keys.size(); k++)
+        keys[k] = (int)k;
+    for (int c = 0; c < countries; c++) {
+        std::uniform_int_distribution<size_t> pick(c, keys.size() - 1);
+        std::swap(keys[c], keys[pick(rng)]);
+    }
+
+    std::string line;
+    char number[32];
+    for (int c = 0; c < countries; c++) {
+        int key = keys[c];
+        char code[4] = { (char)('A' + key / 676), (char)('A' + key / 26 % 26), (char)('A' + key % 26), '\0' };
+        for (int s = 0; s < series; s++) {
+            if (percent(rng) >= coverage)
+                continue;
+            line = "Country " + std::to_string(c) + " Land,";
+            line += code;
+            line += ",Indicator " + std::to_string(s) + " (per capita),IND." + std::to_string(s) + ".ZS";
+            // A slowly drifting walk, like most real indicators.
+            double value = base(rng);
+            for (int y = 0; y < years; y++) {
+                value *= 1.0 + drift(rng);
+                if (percent(rng) < missing) {
+                    line += ",-1";
+                } else {
+                    snprintf(number, sizeof(number), ",%.10g", value);
+                    line += number;
+                }
+            }
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+// serverbench: read throughput of CountryDataServer while a writer keeps reloading and
+// editing the data, next to a single CountryData behind a reader-writer lock.
+//
+// usage: serverbench data.csv [-t max reader threads] [-d seconds per run]
+#include "../CountryDataServer.h"
+#include "../CsvReader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Keeps the optimizer from dropping queries whose results are otherwise unused.
+static std::atomic<size_t> sink(0);
+
+// The baseline: one instance, readers share a lock that writers take exclusively.
+class LockedCountryData {
+private:
+    CountryData data;
+    mutable std::shared_mutex lock;
+
+public:
+    template <class Command>
+    bool write(Command command) {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        return command(data);
+    }
+    bool load(const std::string &f) { return write([&](CountryData &d) { return d.load(f); }); }
+    bool buildCommand(const std::string &s) { return write([&](CountryData &d) { return d.buildCommand(s); }); }
+    bool removeCommand(const std::string &c) { return write([&](CountryData &d) { return d.removeCommand(c); }); }
+    bool insertCommand(const std::string &c, const std::string &f) {
+        return write([&](CountryData &d) { return d.insertCommand(c, f); });
+    }
+    std::pair<int,int> lookupCommand(const std::string &c) const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return data.lookupCommand(c);
+    }
+    std::string findCommand(double mean, const std::string &op) const {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        return data.findCommand(mean, op);
+    }
+};
+
+struct RunResult {
+    long long reads;
+    double maxReadMicros;
+    int writes;
+};
+
+// Readers LOOKUP random codes (and FIND every eighth query) while one writer cycles
+// through LOAD, BUILD, REMOVE and INSERT until the time is up.
+template <class Store>
+static RunResult run(Store &store, const std::string &filename, const std::vector<std::string> &codes,
+                     const std::string &seriesCode, int readers, double seconds) {
+    std::atomic<bool> stop(false);
+    std::atomic<long long> reads(0);
+    std::atomic<int> writes(0);
+    std::vector<double> maxMicros(readers, 0.0);
+
+    std::thread writer([&] {
+        std::mt19937_64 rng(7);
+        std::uniform_int_distribution<size_t> pick(0, codes.size() - 1);
+        while (!stop.load()) {
+            store.load(filename);
+            store.buildCommand(seriesCode);
+            for (int i = 0; i < 4 && !stop.load(); i++) {
+                const std::string &code = codes[pick(rng)];
+                store.removeCommand(code);
+                store.insertCommand(code, filename);
+            }
+            writes.fetch_add(1);
+        }
+    });
+    std::vector<std::thread> workers;
+    for (int t = 0; t < readers; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            std::uniform_int_distribution<size_t> pick(0, codes.size() - 1);
+            long long n = 0;
+            size_t local = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                Clock::time_point start = Clock::now();
+                if (n % 8 == 7)
+                    local += store.findCommand((double)(n % 1000), "less").size();
+                else
+                    local += store.lookupCommand(codes[pick(rng)]).second;
+                double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                maxMicros[t] = std::max(maxMicros[t], micros);
+                n++;
+            }
+            reads.fetch_add(n);
+            sink.fetch_add(local);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    writer.join();
+    RunResult r = { reads.load(), *std::max_element(maxMicros.begin(), maxMicros.end()), writes.load() };
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s data.csv [-t max readers] [-d seconds]\n", argv[0]);
+        return 1;
+    }
+    std::string filename = argv[1];
+    int maxReaders = (int)std::thread::hardware_concurrency();
+    double seconds = 2.0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-t") == 0)
+            maxReaders = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-d") == 0)
+            seconds = atof(argv[i + 1]);
+    }
+    if (maxReaders < 1)
+        maxReaders = 1;
+
+    std::vector<std::string> codes;
+    std::string seriesCode;
+    {
+        MappedFile file;
+        if (!file.open(filename)) {
+            fprintf(stderr, "cannot open %s\n", filename.c_str());
+            return 1;
+        }
+        CsvCursor cursor(file.data(), file.data() + file.size());
+        std::string_view line, cName, cCode, sName, sCode;
+        while (cursor.nextLine(line)) {
+            CsvCursor::nextField(line, cName);
+            CsvCursor::nextField(line, cCode);
+            CsvCursor::nextField(line, sName);
+            CsvCursor::nextField(line, sCode);
+            if (codes.empty() || codes.back() != cCode)
+                codes.emplace_back(cCode);
+            if (seriesCode.empty())
+                seriesCode = std::string(sCode);
+        }
+    }
+    if (codes.empty()) {
+        fprintf(stderr, "%s has no rows\n", filename.c_str());
+        return 1;
+    }
+
+    printf("%-8s %8s %14s %14s %12s %8s\n", "store", "readers", "reads/s", "reads/s/thread", "max read us", "writes");
+    for (int readers = 1; readers <= maxReaders; readers *= 2) {
+        CountryDataServer server;
+        server.load(filename);
+        RunResult a = run(server, filename, codes, seriesCode, readers, seconds);
+        printf("%-8s %8d %14.0f %14.0f %12.1f %8d\n", "server", readers, a.reads / seconds,
+               a.reads / seconds / readers, a.maxReadMicros, a.writes);
+        LockedCountryData locked;
+        locked.load(filename);
+        RunResult b = run(locked, filename, codes, seriesCode, readers, seconds);
+        printf("%-8s %8d %14.0f %14.0f %12.1f %8d\n", "locked", readers, b.reads / seconds,
+               b.reads / seconds / readers, b.maxReadMicros, b.writes);
+    }
+    printf("\n(checksum %zu)\n", sink.load());
+    return 0;
+}
@@ -0,0 +1,85 @@
+// tablebench: compares the country table's schemes. Built once per scheme
+// (see 'make bench-table'); each build LOADs the same file and times LOOKUP hits and
+// misses, before and after a quarter of the countries are REMOVEd.
+//
+// usage: tablebench data.csv [-q lookups] [-s seed]
+#include "../CountryData.h"
+#include "../CsvReader.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Time 'queries' lookups of codes drawn from 'codes'; prints ns per lookup and mean probes.
+static void timeLookups(CountryData &data, const char *label, const std::vector<std::string> &codes,
+                        int queries, std::mt19937_64 &rng) {
+    if (codes.empty())
+        return;
+    std::vector<const std::string *> order(queries);
+    std::uniform_int_distribution<size_t> pick(0, codes.size() - 1);
+    for (int q = 0; q < queries; q++)
+        order[q] = &codes[pick(rng)];
+    long long probes = 0;
+    int found = 0;
+    Clock::time_point start = Clock::now();
+    for (int q = 0; q < queries; q++) {
+        std::pair<int,int> sr = data.lookupCommand(*order[q]);
+        probes += sr.second;
+        found += (sr.first != -1);
+    }
+    double nanos = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-16s %-14s %10d %10.1f %12.3f %8d\n", TABLE_SCHEME, label, queries, nanos / queries,
+           (double)probes / queries, found);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s data.csv [-q lookups] [-s seed]\n", argv[0]);
+        return 1;
+    }
+    std::string filename = argv[1];
+    int queries = 1000000;
+    unsigned long seed = 1;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-q") == 0)
+            queries = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = strtoul(argv[i + 1], nullptr, 10);
+    }
+
+    CountryData data;
+    if (!data.load(filename)) {
+        fprintf(stderr, "cannot load %s\n", filename.c_str());
+        return 1;
+    }
+    // Split the whole three-letter key space into codes in the table and codes not in it.
+    std::vector<std::string> present, absent;
+    for (int key = 0; key < 26 * 26 * 26; key++) {
+        std::string code = { (char)('A' + key / 676), (char)('A' + key / 26 % 26), (char)('A' + key % 26) };
+        if (data.lookupCommand(code).first != -1)
+            present.push_back(code);
+        else
+            absent.push_back(code);
+    }
+
+    std::mt19937_64 rng(seed);
+    timeLookups(data, "hit", present, queries, rng);
+    timeLookups(data, "miss", absent, queries, rng);
+
+    // Leave tombstones behind and measure again.
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < present.size(); i++) {
+        if (i % 4 == 0)
+            data.removeCommand(present[i]);
+        else
+            kept.push_back(present[i]);
+    }
+    timeLookups(data, "hit-removed", kept, queries, rng);
+    timeLookups(data, "miss-removed", absent, queries, rng);
+    return 0;
+}
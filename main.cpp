@@ -1,84 +1,293 @@
 #include "CountryData.h"
+#include "CountryDataServer.h"
+#include "CommandReader.h"
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
-int main() {
-    CountryData countryData;
+// Reads commands from std::cin, exactly as the interactive loop always has.
+struct StreamInput {
+    bool word(std::string &w) { return (bool)(std::cin >> w); }
+    bool line(std::string &l) { return (bool)std::getline(std::cin >> std::ws, l); }
+    bool rest(std::string &l) { return (bool)std::getline(std::cin, l); }
+    bool number(double &d) { return (bool)(std::cin >> d); }
+};
+
+static std::ostream &newline(std::ostream &os) {
+    return os.put('\n');
+}
+
+static bool parseInteger(const std::string &word, int &value) {
+    std::istringstream iss(word);
+    return (iss >> value) && iss.eof();
+}
+
+// Optional BUILD arguments after the series code: a window of years and an aggregate
+// kind, e.g. "1990 2010 max", "1990 2010" or "stddev". None means every year's mean.
+static bool parseBuildOptions(const std::string &options, int &fromYear, int &toYear, AggregateKind &kind) {
+    std::istringstream iss(options);
+    std::string words[4];
+    int n = 0;
+    while (n < 4 && iss >> words[n])
+        n++;
+    if (n == 0)
+        return true;
+    if (n == 1)
+        return CountryData::parseAggregate(words[0], kind);
+    if (n > 3 || !parseInteger(words[0], fromYear) || !parseInteger(words[1], toYear))
+        return false;
+    return n == 2 || CountryData::parseAggregate(words[2], kind);
+}
+
+// INSERT's code argument: one code, a comma-separated list, or "*" for every code in the
+// file that is not in the table (an empty list).
+static bool parseCodeList(const std::string &arg, std::vector<std::string> &codes) {
+    if (arg == "*")
+        return true;
+    size_t start = 0;
+    while (start <= arg.size()) {
+        size_t comma = arg.find(',', start);
+        if (comma == std::string::npos)
+            comma = arg.size();
+        if (comma > start)
+            codes.push_back(arg.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return !codes.empty();
+}
+
+// Run commands from 'in' against a CountryData or a CountryDataServer until EXIT or the
+// input runs out, writing responses to 'out'. Each response line ends with endLine:
+// std::endl interactively, a plain newline in batch and client mode.
+template <class Data, class Input>
+static void serve(Data &countryData, Input &in, std::ostream &out, std::ostream &(*endLine)(std::ostream &)) {
     std::string command;
-    
-    while (std::cin >> command) {
+    while (in.word(command)) {
         if (command == "LOAD") {
             std::string filename;
-            std::cin >> filename;
+            in.word(filename);
             if (countryData.load(filename)) {
-                std::cout << "success" << std::endl;
+                out << "success" << endLine;
             }
         }
         else if (command == "BUILD") {
-            std::string seriesCode;
-            std::cin >> seriesCode;
-            if (countryData.buildCommand(seriesCode)) {
-                std::cout << "success" << std::endl;
+            std::string seriesCode, options;
+            in.word(seriesCode);
+            in.rest(options);
+            int fromYear = 0, toYear = 0;
+            AggregateKind kind = AGG_MEAN;
+            if (parseBuildOptions(options, fromYear, toYear, kind) &&
+                countryData.buildCommand(seriesCode, fromYear, toYear, kind)) {
+                out << "success" << endLine;
             }
         }
         else if (command == "LIST") {
             std::string country;
-            std::getline(std::cin >> std::ws, country);
-            std::cout << countryData.listCommand(country) << std::endl;
+            in.line(country);
+            out << countryData.listCommand(country) << endLine;
         }
         else if (command == "RANGE") {
             std::string seriesCode;
-            std::cin >> seriesCode;
-            std::cout << countryData.rangeCommand(seriesCode) << std::endl;
+            in.word(seriesCode);
+            out << countryData.rangeCommand(seriesCode) << endLine;
         }
         else if (command == "FIND") {
             double mean;
             std::string op;
-            std::cin >> mean >> op;
-            std::cout << countryData.findCommand(mean, op) << std::endl;
+            in.number(mean);
+            in.word(op);
+            out << countryData.findCommand(mean, op) << endLine;
         }
         else if (command == "DELETE") {
             std::string country;
-            std::getline(std::cin >> std::ws, country);
+            in.line(country);
             if (countryData.deleteCommand(country)) {
-                std::cout << "success" << std::endl;
+                out << "success" << endLine;
             } else {
-                std::cout << "failure" << std::endl;
+                out << "failure" << endLine;
             }
         }
         else if (command == "LIMITS") {
             std::string condition;
-            std::cin >> condition;
-            std::cout << countryData.limitsCommand(condition) << std::endl;
+            in.word(condition);
+            out << countryData.limitsCommand(condition) << endLine;
+        }
+        else if (command == "TOPK") {
+            std::string count, condition;
+            in.word(count);
+            in.word(condition);
+            int k;
+            if (!parseInteger(count, k))
+                k = 0; // not a count, so it fails
+            out << countryData.topkCommand(k, condition) << endLine;
+        }
+        else if (command == "PERCENTILE") {
+            double p;
+            if (!in.number(p))
+                p = -1.0; // out of range, so it fails
+            out << countryData.percentileCommand(p) << endLine;
         }
         else if (command == "LOOKUP") {
             std::string code;
-            std::cin >> code;
+            in.word(code);
             std::pair<int,int> sr = countryData.lookupCommand(code);
             if (sr.first == -1)
-                std::cout << "failure" << std::endl;
+                out << "failure" << endLine;
             else
-                std::cout << "index " << sr.first << " searches " << sr.second << std::endl;
+                out << "index " << sr.first << " searches " << sr.second << endLine;
         }
         else if (command == "REMOVE") {
             std::string code;
-            std::cin >> code;
+            in.word(code);
             if (countryData.removeCommand(code))
-                std::cout << "success" << std::endl;
+                out << "success" << endLine;
             else
-                std::cout << "failure" << std::endl;
+                out << "failure" << endLine;
         }
         else if (command == "INSERT") {
             std::string code, filename;
-            std::cin >> code >> filename;
-            if (countryData.insertCommand(code, filename))
-                std::cout << "success" << std::endl;
+            in.word(code);
+            in.word(filename);
+            bool inserted;
+            if (code == "*" || code.find(',') != std::string::npos) {
+                std::vector<std::string> codes;
+                inserted = parseCodeList(code, codes) && countryData.insertBatchCommand(codes, filename) > 0;
+            } else {
+                inserted = countryData.insertCommand(code, filename);
+            }
+            if (inserted)
+                out << "success" << endLine;
             else
-                std::cout << "failure" << std::endl;
+                out << "failure" << endLine;
+        }
+        else if (command == "INDEX") {
+            std::string filename;
+            in.word(filename);
+            if (countryData.indexCommand(filename))
+                out << "success" << endLine;
+            else
+                out << "failure" << endLine;
+        }
+        else if (command == "APPEND") {
+            std::string filename;
+            in.word(filename);
+            if (countryData.appendCommand(filename))
+                out << "success" << endLine;
+            else
+                out << "failure" << endLine;
+        }
+        else if (command == "SAVE") {
+            std::string filename;
+            in.word(filename);
+            if (countryData.saveCommand(filename))
+                out << "success" << endLine;
+            else
+                out << "failure" << endLine;
+        }
+        else if (command == "OPEN") {
+            std::string filename;
+            in.word(filename);
+            if (countryData.openCommand(filename))
+                out << "success" << endLine;
+            else
+                out << "failure" << endLine;
+        }
+        else if (command == "STATS") {
+            out << countryData.statsCommand() << endLine;
+        }
+        else if (command == "FLUSH") {
+            out.flush();
         }
         else if (command == "EXIT") {
             break;
         }
     }
+}
+
+// Client mode: each command file is served on its own thread against one shared
+// CountryDataServer, and its responses go to <file>.out. Queries from different clients
+// run in parallel and never wait for a writer; LOAD, BUILD, INSERT and the other
+// writers are applied one at a time. Returns false if a file could not be served.
+static bool serveClients(CountryDataServer &server, const std::vector<std::string> &files) {
+    std::vector<char> served(files.size(), 0);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < files.size(); c++) {
+        clients.emplace_back([&server, &files, &served, c]() {
+            int fd = open(files[c].c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+            std::ofstream out(files[c] + ".out");
+            CommandReader in(fd, nullptr);
+            serve(server, in, out, newline);
+            out.flush();
+            close(fd);
+            served[c] = out.good();
+        });
+    }
+    bool ok = true;
+    for (size_t c = 0; c < clients.size(); c++) {
+        clients[c].join();
+        ok = ok && served[c];
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    bool batch = false;
+    int threads = 1;
+    bool lazy = false;
+    std::vector<std::string> clientFiles;
+
+    // -j N: parse LOAD files and aggregate BUILDs with N threads (0 = one per hardware thread).
+    // -l: lazy LOAD; a series code's values are parsed when a command first needs them.
+    // -c FILE (repeatable): client mode, see serveClients; stdin is not read.
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+            if (threads <= 0)
+                threads = (int)std::thread::hardware_concurrency();
+        } else if (arg == "-b") {
+            batch = true;
+        } else if (arg == "-l") {
+            lazy = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            clientFiles.push_back(argv[++i]);
+        }
+    }
+
+    if (!clientFiles.empty()) {
+        CountryDataServer server;
+        server.setLoadThreads(threads);
+        server.setBuildThreads(threads);
+        server.setLazyLoad(lazy);
+        return serveClients(server, clientFiles) ? 0 : 1;
+    }
+
+    CountryData countryData;
+    countryData.setLoadThreads(threads);
+    countryData.setBuildThreads(threads);
+    countryData.setLazyLoad(lazy);
+
+    if (batch) {
+        // Batch mode: stdout is untied and block-buffered, and it is only flushed when the
+        // next block of input is read, on FLUSH, and at exit.
+        static char outputBuffer[1 << 16];
+        std::ios_base::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+        std::cout.rdbuf()->pubsetbuf(outputBuffer, sizeof(outputBuffer));
+        CommandReader in(STDIN_FILENO, &std::cout);
+        serve(countryData, in, std::cout, newline);
+        std::cout.flush();
+    } else {
+        StreamInput in;
+        serve(countryData, in, std::cout, std::endl);
+    }
     return 0;
 }
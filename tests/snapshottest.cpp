@@ -0,0 +1,113 @@
+// snapshottest: OPEN of a snapshot it cannot use (another scheme's, or corrupt in a way
+// the checksum does not catch) must fail and leave the current data exactly as it was.
+// Built once per table scheme (see 'make test').
+//
+// usage: snapshottest
+#include "../CountryData.h"
+#include "../Snapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+static bool writeFile(const std::string &filename, const char *text) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (f == nullptr)
+        return false;
+    bool ok = fputs(text, f) >= 0;
+    return (fclose(f) == 0) && ok;
+}
+
+// A snapshot under 'scheme' with no columns and no build. With countrySlot < 0 the table
+// is empty; otherwise slot 0 is occupied and its one country claims to be at countrySlot.
+// numColumns is written as given, so a negative count makes a corrupt snapshot whose
+// checksum still matches.
+static bool writeSnapshot(const std::string &filename, const char *scheme, int64_t numColumns = 0,
+                          int64_t countrySlot = -1) {
+    SnapshotWriter out;
+    out.putString(scheme);
+    out.putInt(FIRST_TABLE_SIZE);
+    int *status = new int[FIRST_TABLE_SIZE]();
+    if (countrySlot >= 0)
+        status[0] = STATUS_OCCUPIED;
+    out.putArray(status, FIRST_TABLE_SIZE * sizeof(int));
+    delete[] status;
+    out.putInt(numColumns);
+    if (countrySlot >= 0) {
+        out.putInt(1);
+        out.putInt(countrySlot);
+        out.putString("Cland");
+        out.putString("CCC");
+        out.putInt(0);  // series
+    } else {
+        out.putInt(0);
+    }
+    out.putString("");
+    for (int i = 0; i < 5; i++)
+        out.putInt(0);  // build years, kind, complete flag and entry count
+    return out.writeTo(filename);
+}
+
+// The table LOADed from 'csv' must still answer LOOKUP and BUILD as before the OPEN.
+static void checkLoaded(const CountryData &data, std::pair<int,int> before) {
+    CHECK(data.lookupCommand("AAA") == before);
+    CHECK(data.lookupCommand("BBB").first != -1);
+    CHECK(data.rangeCommand("S.1") == "1.5 3.5");
+}
+
+int main() {
+    char dir[] = "/tmp/snapshottest.XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string csv = std::string(dir) + "/data.csv";
+    std::string snap = std::string(dir) + "/data.snap";
+    CHECK(writeFile(csv, "Aland,AAA,Series one,S.1,1,2\n"
+                         "Bland,BBB,Series one,S.1,3,4\n"));
+
+    CountryData data;
+    CHECK(data.load(csv));
+    CHECK(data.buildCommand("S.1", 0, 0, AGG_MEAN));
+    std::pair<int,int> before = data.lookupCommand("AAA");
+    CHECK(before.first != -1);
+    checkLoaded(data, before);
+
+    // A snapshot written by a build with another probing scheme.
+    const char *otherScheme = (strcmp(TABLE_SCHEME, "swiss") == 0) ? "double-hashing" : "swiss";
+    CHECK(writeSnapshot(snap, otherScheme));
+    CHECK(!data.openCommand(snap));
+    checkLoaded(data, before);
+
+    // This build's scheme, but corrupt past the slot layout.
+    CHECK(writeSnapshot(snap, TABLE_SCHEME, -1));
+    CHECK(!data.openCommand(snap));
+    checkLoaded(data, before);
+    CHECK(writeSnapshot(snap, TABLE_SCHEME, 0, FIRST_TABLE_SIZE));
+    CHECK(!data.openCommand(snap));
+    checkLoaded(data, before);
+
+    // Well-formed snapshots under this build's scheme open, and replace the table.
+    CHECK(writeSnapshot(snap, TABLE_SCHEME, 0, 0));
+    CHECK(data.openCommand(snap));
+    CHECK(data.lookupCommand("BBB").first == -1);
+    CHECK(writeSnapshot(snap, TABLE_SCHEME));
+    CHECK(data.openCommand(snap));
+
+    unlink(csv.c_str());
+    unlink(snap.c_str());
+    rmdir(dir);
+    printf("snapshottest %s: %s\n", TABLE_SCHEME, failures == 0 ? "ok" : "FAILED");
+    return (failures == 0) ? 0 : 1;
+}